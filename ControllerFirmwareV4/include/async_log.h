@@ -0,0 +1,217 @@
+#pragma once
+#include <Arduino.h>
+#include <TelnetSpy.h>
+#include <atomic>
+#include "spsc_queue.h"
+
+// Log front end that never blocks the caller. Every write is copied into a
+// ring buffer as one record, a low priority task drains the records to
+// TelnetSpy, which sends them to telnet and serial. Any task may log,
+// writers reserve their record with a compare and swap and never wait on
+// each other or on the network. A write that does not fit is dropped and
+// counted. Telnet input is read by the same task and handed to the loop task.
+class AsyncLog : public Print
+{
+    static_assert(ASYNC_LOG_BUFFER_SIZE >= 64 && (ASYNC_LOG_BUFFER_SIZE & (ASYNC_LOG_BUFFER_SIZE - 1)) == 0, "ASYNC_LOG_BUFFER_SIZE must be a power of two");
+
+private:
+    static const uint32_t HEADER_SIZE = 4;
+    static const uint32_t READY_FLAG = 0x80000000UL; // Set in a header once its record is written
+
+    TelnetSpy &sink;
+    TaskHandle_t drainTaskHandle;
+
+    // Records are a 4 byte header followed by the text, padded to 4 bytes.
+    // Positions run freely and wrap through the buffer.
+    alignas(4) uint8_t buffer[ASYNC_LOG_BUFFER_SIZE];
+    std::atomic<uint32_t> head; // Next position to reserve, advanced by the writers
+    std::atomic<uint32_t> tail; // Next record to drain, advanced by the drain task
+    std::atomic<uint32_t> droppedWrites; // Since boot
+    std::atomic<uint32_t> droppedBytes;
+    uint32_t reportedDrops;              // Drain task only
+
+    SpscQueue<uint8_t, ASYNC_LOG_INPUT_SIZE> input; // Drain task -> loop task
+
+    uint32_t *getHeader(uint32_t position)
+    {
+        return (uint32_t *)&buffer[position % ASYNC_LOG_BUFFER_SIZE];
+    }
+
+    static void drainTask(void *parameter)
+    {
+        AsyncLog *log = (AsyncLog *)parameter;
+
+        for (;;)
+        {
+            log->drain();
+            log->sink.handle();
+            log->readInput();
+            vTaskDelay(pdMS_TO_TICKS(ASYNC_LOG_DRAIN_PERIOD));
+        }
+    }
+
+    void drain()
+    {
+        uint32_t position = tail.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            uint32_t header = __atomic_load_n(getHeader(position), __ATOMIC_ACQUIRE);
+            if ((header & READY_FLAG) == 0)
+            {
+                // Empty, or the next writer is still copying its record
+                break;
+            }
+
+            uint32_t length = header & ~READY_FLAG;
+            uint32_t recordSize = HEADER_SIZE + ((length + 3) & ~3UL);
+            copyOut(position + HEADER_SIZE, length);
+
+            // Zero the record so a later header landing inside it reads as not ready
+            clear(position, recordSize);
+            position += recordSize;
+            tail.store(position, std::memory_order_release);
+        }
+
+        uint32_t dropped = droppedWrites;
+        if (dropped != reportedDrops)
+        {
+            sink.printf("Log buffer full, %u messages dropped, %u bytes since boot.\n", (unsigned int)(dropped - reportedDrops), (unsigned int)droppedBytes);
+            reportedDrops = dropped;
+        }
+    }
+
+    void copyOut(uint32_t position, uint32_t length)
+    {
+        uint32_t offset = position % ASYNC_LOG_BUFFER_SIZE;
+        uint32_t first = min(length, (uint32_t)ASYNC_LOG_BUFFER_SIZE - offset);
+
+        // Through Print, TelnetSpy hides the buffer overload
+        Print &out = sink;
+        out.write(&buffer[offset], first);
+        if (first < length)
+        {
+            out.write(&buffer[0], length - first);
+        }
+    }
+
+    void copyIn(uint32_t position, const uint8_t *data, uint32_t length)
+    {
+        uint32_t offset = position % ASYNC_LOG_BUFFER_SIZE;
+        uint32_t first = min(length, (uint32_t)ASYNC_LOG_BUFFER_SIZE - offset);
+
+        memcpy(&buffer[offset], data, first);
+        if (first < length)
+        {
+            memcpy(&buffer[0], data + first, length - first);
+        }
+    }
+
+    void clear(uint32_t position, uint32_t length)
+    {
+        uint32_t offset = position % ASYNC_LOG_BUFFER_SIZE;
+        uint32_t first = min(length, (uint32_t)ASYNC_LOG_BUFFER_SIZE - offset);
+
+        memset(&buffer[offset], 0, first);
+        if (first < length)
+        {
+            memset(&buffer[0], 0, length - first);
+        }
+    }
+
+    void readInput()
+    {
+        while (input.size() < ASYNC_LOG_INPUT_SIZE && sink.available() > 0)
+        {
+            input.push((uint8_t)sink.read());
+        }
+    }
+
+public:
+    AsyncLog(TelnetSpy &telnetSpy) : sink(telnetSpy), drainTaskHandle(NULL), head(0), tail(0), droppedWrites(0), droppedBytes(0), reportedDrops(0)
+    {
+        memset(buffer, 0, sizeof(buffer));
+    }
+
+    void begin(unsigned long baud)
+    {
+        sink.begin(baud);
+        xTaskCreatePinnedToCore(drainTask, "log", ASYNC_LOG_TASK_STACK_SIZE, this, ASYNC_LOG_TASK_PRIORITY, &drainTaskHandle, ASYNC_LOG_TASK_CORE);
+    }
+
+    void setWelcomeMsg(char *message)
+    {
+        sink.setWelcomeMsg(message);
+    }
+
+    using Print::write;
+
+    size_t write(uint8_t c) override
+    {
+        return write(&c, 1);
+    }
+
+    size_t write(const uint8_t *data, size_t size) override
+    {
+        if (size == 0)
+        {
+            return 0;
+        }
+
+        uint32_t recordSize = HEADER_SIZE + ((size + 3) & ~3UL);
+        uint32_t position = head.load(std::memory_order_relaxed);
+
+        do
+        {
+            if (recordSize > ASYNC_LOG_BUFFER_SIZE - (position - tail.load(std::memory_order_acquire)))
+            {
+                droppedWrites++;
+                droppedBytes += size;
+                return 0;
+            }
+        } while (!head.compare_exchange_weak(position, position + recordSize, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+        copyIn(position + HEADER_SIZE, data, size);
+        __atomic_store_n(getHeader(position), (uint32_t)size | READY_FLAG, __ATOMIC_RELEASE);
+        return size;
+    }
+
+    // Waits until the drain task has sent everything, e.g. before a restart
+    void flush() override
+    {
+        unsigned long start = millis();
+        while (tail.load(std::memory_order_acquire) != head.load(std::memory_order_acquire) && millis() - start < ASYNC_LOG_FLUSH_TIMEOUT)
+        {
+            delay(1);
+        }
+        sink.flush();
+    }
+
+    uint32_t getDroppedWrites()
+    {
+        return droppedWrites;
+    }
+
+    uint32_t getDroppedBytes()
+    {
+        return droppedBytes;
+    }
+
+    // Telnet input, loop task only
+    int available()
+    {
+        return (int)input.size();
+    }
+
+    int peek()
+    {
+        uint8_t c;
+        return input.peek(c) ? c : -1;
+    }
+
+    int read()
+    {
+        uint8_t c;
+        return input.pop(c) ? c : -1;
+    }
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include "shared.h"
+#include <type_traits>
+
+// Log sites written as LOG_EVENT(format, args...). In text mode that is a
+// plain LOG.printf(). With BINARY_LOG set the format string never reaches the
+// device: its hash is the message ID, computed at compile time, and only the
+// ID and the raw arguments are written as one record. tools/log_decoder.cpp
+// finds the LOG_EVENT formats in the sources and turns records back into text.
+//
+// Record: BINARY_LOG_MARKER, ID (4 bytes), payload length (1 byte), payload.
+// Integers and chars are 4 bytes, floats are 4 byte floats, strings are a
+// length byte followed by the text. Everything is little endian.
+#if BINARY_LOG
+#define LOG_EVENT(format, ...)                                              \
+    do                                                                      \
+    {                                                                       \
+        constexpr uint32_t logMessageId = BinaryLog::messageId(format);     \
+        if (false)                                                          \
+        {                                                                   \
+            BinaryLog::checkFormat(format, ##__VA_ARGS__);                  \
+        }                                                                   \
+        BinaryLog::write(logMessageId, ##__VA_ARGS__);                      \
+    } while (0)
+#else
+#define LOG_EVENT(format, ...) LOG.printf(format, ##__VA_ARGS__)
+#endif
+
+class BinaryLog
+{
+private:
+    static const size_t HEADER_SIZE = 6;
+
+    static void encode(uint8_t *record, size_t &length)
+    {
+    }
+
+    template <typename T, typename... Args>
+    static void encode(uint8_t *record, size_t &length, T value, Args... args)
+    {
+        encodeValue(record, length, value);
+        encode(record, length, args...);
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type encodeValue(uint8_t *record, size_t &length, T value)
+    {
+        uint32_t raw = (uint32_t)value;
+        append(record, length, &raw, sizeof(raw));
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type encodeValue(uint8_t *record, size_t &length, T value)
+    {
+        float raw = (float)value;
+        append(record, length, &raw, sizeof(raw));
+    }
+
+    static void encodeValue(uint8_t *record, size_t &length, const char *text)
+    {
+        if (length >= BINARY_LOG_MAX_RECORD)
+        {
+            return;
+        }
+
+        // Cut to what is left of the record
+        size_t textLength = strlen(text);
+        size_t room = BINARY_LOG_MAX_RECORD - length - 1;
+        uint8_t size = (uint8_t)min(textLength, min(room, (size_t)255));
+
+        record[length++] = size;
+        memcpy(&record[length], text, size);
+        length += size;
+    }
+
+    static void encodeValue(uint8_t *record, size_t &length, const String &text)
+    {
+        encodeValue(record, length, text.c_str());
+    }
+
+    static void append(uint8_t *record, size_t &length, const void *value, size_t size)
+    {
+        // Arguments that do not fit are left off, the decoder prints them as ?
+        if (length + size <= BINARY_LOG_MAX_RECORD)
+        {
+            memcpy(&record[length], value, size);
+            length += size;
+        }
+        else
+        {
+            length = BINARY_LOG_MAX_RECORD;
+        }
+    }
+
+public:
+    // FNV-1a, tools/log_decoder.cpp computes the same hash
+    static constexpr uint32_t messageId(const char *format)
+    {
+        uint32_t hash = 2166136261UL;
+        while (*format != '\0')
+        {
+            hash = (hash ^ (uint8_t)*format++) * 16777619UL;
+        }
+        return hash;
+    }
+
+    // Never called, lets the compiler check the arguments against the format
+    static void checkFormat(const char *format, ...) __attribute__((format(printf, 1, 2)))
+    {
+    }
+
+    template <typename... Args>
+    static void write(uint32_t id, Args... args)
+    {
+        uint8_t record[BINARY_LOG_MAX_RECORD];
+        size_t length = HEADER_SIZE;
+
+        record[0] = BINARY_LOG_MARKER;
+        memcpy(&record[1], &id, sizeof(id));
+        encode(record, length, args...);
+        record[5] = (uint8_t)(length - HEADER_SIZE);
+
+        // One write, so the record stays in one piece in the log buffer
+        LOG.write(record, length);
+    }
+};
@@ -0,0 +1,137 @@
+#pragma once
+#include "shared.h"
+#include "step_engine.h"
+#include <soc/gpio_struct.h>
+
+enum class Endstop : uint8_t
+{
+    OPEN = 0,
+    CLOSED = 1
+};
+
+// Interrupt driven endstops. Every edge restarts a one-shot filter timer and
+// the level is only accepted once it has been stable for
+// ENDSTOP_GLITCH_FILTER_US, which rejects EMI spikes from the stepper. A newly
+// triggered endstop stops the step engine from the filter timer ISR, so the
+// stop latency does not depend on the motion task or loop().
+class Endstops
+{
+private:
+    static const uint8_t pins[2];
+    static const uint8_t timerNums[2];
+    static hw_timer_t *filterTimers[2];
+    static volatile bool triggered[2];       // Filtered state
+    static volatile uint32_t glitchCount[2]; // Edges that did not last long enough
+
+    static bool IRAM_ATTR readPin(uint8_t index);
+    static void IRAM_ATTR onEdge(uint8_t index);
+    static void IRAM_ATTR onSettled(uint8_t index);
+    static void IRAM_ATTR onOpenEdge();
+    static void IRAM_ATTR onClosedEdge();
+    static void IRAM_ATTR onOpenSettled();
+    static void IRAM_ATTR onClosedSettled();
+
+public:
+    static void begin();
+
+    static bool isTriggered(Endstop endstop);
+    static uint32_t getGlitchCount(Endstop endstop);
+};
+
+// Static member definitions
+DRAM_ATTR const uint8_t Endstops::pins[2] = {OPEN_ENDSTOP_PIN, CLOSE_ENDSTOP_PIN};
+const uint8_t Endstops::timerNums[2] = {ENDSTOP_OPEN_TIMER_NUM, ENDSTOP_CLOSED_TIMER_NUM};
+DRAM_ATTR hw_timer_t *Endstops::filterTimers[2] = {NULL, NULL};
+volatile bool Endstops::triggered[2] = {false, false};
+volatile uint32_t Endstops::glitchCount[2] = {0, 0};
+
+// Private methods
+bool IRAM_ATTR Endstops::readPin(uint8_t index)
+{
+    // Endstops pull the pin low when triggered
+    return (GPIO.in & (1UL << pins[index])) == 0;
+}
+
+void IRAM_ATTR Endstops::onEdge(uint8_t index)
+{
+#if ENDSTOP_GLITCH_FILTER_US > 0
+    // Restart the filter window on every edge
+    timerWrite(filterTimers[index], 0);
+    timerAlarmEnable(filterTimers[index]);
+#else
+    onSettled(index);
+#endif
+}
+
+void IRAM_ATTR Endstops::onSettled(uint8_t index)
+{
+    bool level = readPin(index);
+
+    if (level == triggered[index])
+    {
+        // Back where it was, the edge was a glitch
+        glitchCount[index] = glitchCount[index] + 1;
+        return;
+    }
+
+    triggered[index] = level;
+
+    if (level)
+    {
+        StepEngine::onEndstopTriggered(index == (uint8_t)Endstop::CLOSED);
+    }
+}
+
+void IRAM_ATTR Endstops::onOpenEdge()
+{
+    onEdge((uint8_t)Endstop::OPEN);
+}
+
+void IRAM_ATTR Endstops::onClosedEdge()
+{
+    onEdge((uint8_t)Endstop::CLOSED);
+}
+
+void IRAM_ATTR Endstops::onOpenSettled()
+{
+    onSettled((uint8_t)Endstop::OPEN);
+}
+
+void IRAM_ATTR Endstops::onClosedSettled()
+{
+    onSettled((uint8_t)Endstop::CLOSED);
+}
+
+// Public methods
+void Endstops::begin()
+{
+    void (*edgeHandlers[2])() = {onOpenEdge, onClosedEdge};
+#if ENDSTOP_GLITCH_FILTER_US > 0
+    void (*settledHandlers[2])() = {onOpenSettled, onClosedSettled};
+#endif
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        pinMode(pins[i], INPUT_PULLUP);
+        triggered[i] = readPin(i);
+
+#if ENDSTOP_GLITCH_FILTER_US > 0
+        // One-shot timer with 1us ticks
+        filterTimers[i] = timerBegin(timerNums[i], STEP_TIMER_DIVIDER, true);
+        timerAttachInterrupt(filterTimers[i], settledHandlers[i], true);
+        timerAlarmWrite(filterTimers[i], ENDSTOP_GLITCH_FILTER_US, false);
+#endif
+
+        attachInterrupt(digitalPinToInterrupt(pins[i]), edgeHandlers[i], CHANGE);
+    }
+}
+
+bool Endstops::isTriggered(Endstop endstop)
+{
+    return triggered[(uint8_t)endstop];
+}
+
+uint32_t Endstops::getGlitchCount(Endstop endstop)
+{
+    return glitchCount[(uint8_t)endstop];
+}
@@ -0,0 +1,193 @@
+#pragma once
+#include "shared.h"
+#include "spsc_queue.h"
+#include "binary_log.h"
+#include "temperature_format.h"
+
+enum class WindowState : uint8_t
+{
+    NONE = 0,
+    CLOSING = 1,
+    OPENING = 2,
+    CLOSED = 3,
+    OPEN = 4,
+    CLOSING_ERROR = 5,
+    OPENING_ERROR = 6,
+    UPDATING = 7,
+    UPDATE_COMPLETE = 8,
+    RESTARTING = 9,
+    PARTIALLY_OPEN = 10
+};
+
+// Error event definitions
+enum class ErrorCode : uint8_t
+{
+    NONE = 0,
+    MOTOR_ENDSTOP_ERROR = 1,
+    UPDATE_ERROR = 2
+};
+
+enum class Connectivity : uint8_t
+{
+    WIFI_CONNECTED = 0,
+    WIFI_DISCONNECTED = 1,
+    MQTT_CONNECTED = 2,
+    MQTT_DISCONNECTED = 3,
+    MQTT_CONNECTING = 4
+};
+
+enum class EventType : uint8_t
+{
+    WINDOW_STATE = 0,
+    ERROR = 1,
+    CONNECTIVITY = 2,
+    TEMPERATURE = 3
+};
+
+struct Event
+{
+    EventType type;
+    union
+    {
+        WindowState windowState;
+        ErrorCode error;
+        Connectivity connectivity;
+        struct
+        {
+            TemperatureRaw temperature; // 1/16 C
+            uint8_t sensor;             // Index of the sensor found at boot
+        };
+    };
+
+    static Event windowStateChanged(WindowState state)
+    {
+        Event event;
+        event.type = EventType::WINDOW_STATE;
+        event.windowState = state;
+        return event;
+    }
+
+    static Event errorOccured(ErrorCode code)
+    {
+        Event event;
+        event.type = EventType::ERROR;
+        event.error = code;
+        return event;
+    }
+
+    static Event connectivityChanged(Connectivity state)
+    {
+        Event event;
+        event.type = EventType::CONNECTIVITY;
+        event.connectivity = state;
+        return event;
+    }
+
+    static Event temperatureRead(uint8_t sensor, TemperatureRaw temperature)
+    {
+        Event event;
+        event.type = EventType::TEMPERATURE;
+        event.temperature = temperature;
+        event.sensor = sensor;
+        return event;
+    }
+};
+
+// Fixed size publish/subscribe bus. Publishing only queues the event, the
+// subscribers run later from dispatch() in the loop task, so a publisher
+// never waits on the LED, logging or MQTT. The motion task and the loop task
+// each have their own queue to keep both sides lock-free.
+class EventBus
+{
+private:
+    struct Subscriber
+    {
+        EventType type;
+        void (*handler)(const Event &event);
+    };
+
+    static Subscriber subscribers[EVENT_BUS_MAX_SUBSCRIBERS];
+    static uint8_t subscriberCount;
+    static SpscQueue<Event, EVENT_BUS_QUEUE_SIZE> motionQueue; // Motion task -> loop task
+    static SpscQueue<Event, EVENT_BUS_QUEUE_SIZE> loopQueue;   // Loop task -> loop task
+    static std::atomic<uint32_t> droppedEvents;
+
+    static void deliver(const Event &event);
+
+public:
+    static bool subscribe(EventType type, void (*handler)(const Event &event));
+    static void publish(const Event &event);           // Loop task only
+    static void publishFromMotion(const Event &event); // Motion task only
+    static void dispatch();
+};
+
+// Static member definitions
+EventBus::Subscriber EventBus::subscribers[EVENT_BUS_MAX_SUBSCRIBERS];
+uint8_t EventBus::subscriberCount = 0;
+SpscQueue<Event, EVENT_BUS_QUEUE_SIZE> EventBus::motionQueue;
+SpscQueue<Event, EVENT_BUS_QUEUE_SIZE> EventBus::loopQueue;
+std::atomic<uint32_t> EventBus::droppedEvents(0);
+
+// Private methods
+void EventBus::deliver(const Event &event)
+{
+    // Subscribers run in the order they subscribed
+    for (uint8_t i = 0; i < subscriberCount; i++)
+    {
+        if (subscribers[i].type == event.type)
+        {
+            subscribers[i].handler(event);
+        }
+    }
+}
+
+// Public methods
+bool EventBus::subscribe(EventType type, void (*handler)(const Event &event))
+{
+    if (subscriberCount >= EVENT_BUS_MAX_SUBSCRIBERS)
+    {
+        LOG.println("Event bus is full, subscriber not added.");
+        return false;
+    }
+
+    subscribers[subscriberCount++] = {type, handler};
+    return true;
+}
+
+void EventBus::publish(const Event &event)
+{
+    if (!loopQueue.push(event))
+    {
+        droppedEvents++;
+    }
+}
+
+void EventBus::publishFromMotion(const Event &event)
+{
+    if (!motionQueue.push(event))
+    {
+        droppedEvents++;
+    }
+}
+
+void EventBus::dispatch()
+{
+    Event event;
+
+    // Motion events first, they are the ones the rest of the system reacts to
+    while (motionQueue.pop(event))
+    {
+        deliver(event);
+    }
+
+    while (loopQueue.pop(event))
+    {
+        deliver(event);
+    }
+
+    uint32_t dropped = droppedEvents.exchange(0);
+    if (dropped > 0)
+    {
+        LOG_EVENT("Event bus queue full, %u events dropped.\n", (unsigned int)dropped);
+    }
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "shared.h"
+#include "event_bus.h"
 
 // Status color definitions
 enum class StatusColors : uint8_t
@@ -18,14 +19,6 @@ enum class StatusColors : uint8_t
     OFF = 11
 };
 
-// Error event definitions
-enum class ErrorCode : uint8_t
-{
-    NONE = 0,
-    MOTOR_ENDSTOP_ERROR = 1,
-    UPDATE_ERROR = 2
-};
-
 class LedControl
 {
 private:
@@ -43,6 +36,11 @@ private:
     static bool errorHasOccured;
     static ErrorCode errorCode;
 
+    // Event bus subscribers
+    static void onWindowStateEvent(const Event &event);
+    static void onErrorEvent(const Event &event);
+    static void onConnectivityEvent(const Event &event);
+
 public:
     // Methods
     static void setStatusLedColor(CRGB newColor, bool dimLed = true);
@@ -73,6 +71,56 @@ bool LedControl::errorHasOccured = false;
 ErrorCode LedControl::errorCode = ErrorCode::NONE;
 
 
+// Private methods
+void LedControl::onWindowStateEvent(const Event &event)
+{
+    switch (event.windowState)
+    {
+    case WindowState::CLOSING:
+        setStatusLedColor(StatusColors::CLOSING);
+        setLedDimTemp(false); // Temp disable led dimming
+        break;
+
+    case WindowState::OPENING:
+        setStatusLedColor(StatusColors::OPENING);
+        setLedDimTemp(false); // Temp disable led dimming
+        break;
+
+    case WindowState::UPDATING:
+    case WindowState::UPDATE_COMPLETE:
+    case WindowState::RESTARTING:
+        // The OTA and restart paths set their own colors
+        break;
+
+    default:
+        setBaseStatus();
+        setLedDimTemp(true); // Re-enable led dimming
+        break;
+    }
+}
+
+void LedControl::onErrorEvent(const Event &event)
+{
+    setErrorHasOccured(true, event.error);
+    setBaseStatus();
+}
+
+void LedControl::onConnectivityEvent(const Event &event)
+{
+    if (event.connectivity == Connectivity::WIFI_CONNECTED)
+    {
+        setStatusLedColor(StatusColors::WIFI_CONNECTED);
+    }
+    else if (event.connectivity == Connectivity::MQTT_CONNECTING)
+    {
+        setStatusLedColor(StatusColors::MQTT_CONNNECTING, false);
+    }
+    else
+    {
+        setBaseStatus();
+    }
+}
+
 // Public methods
 void LedControl::setStatusLedColor(CRGB newColor, bool dimLed)
 {
@@ -228,6 +276,10 @@ void LedControl::begin()
 
     errorHasOccured = false;
 
+    EventBus::subscribe(EventType::WINDOW_STATE, onWindowStateEvent);
+    EventBus::subscribe(EventType::ERROR, onErrorEvent);
+    EventBus::subscribe(EventType::CONNECTIVITY, onConnectivityEvent);
+
     FastLED.addLeds<WS2812B, RGB_LED_PIN, GRB>(statusLedColor, 1);
     FastLED.setBrightness(255);
     setStatusLedColor(StatusColors::OFF);
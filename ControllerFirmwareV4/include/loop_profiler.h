@@ -0,0 +1,228 @@
+#pragma once
+#include "shared.h"
+
+// Wrap each handle() call in loop() with LOOP_PROFILE(). With LOOP_PROFILER
+// set to 0 the macros expand to the bare calls and nothing here is compiled.
+#if LOOP_PROFILER
+#define LOOP_PROFILE(module, call)                                         \
+    do                                                                     \
+    {                                                                      \
+        uint32_t profileStart = ESP.getCycleCount();                       \
+        call;                                                              \
+        LoopProfiler::record(module, ESP.getCycleCount() - profileStart);  \
+    } while (0)
+#define LOOP_PROFILE_BEGIN() LoopProfiler::beginLoop()
+#define LOOP_PROFILE_END() LoopProfiler::endLoop()
+#else
+#define LOOP_PROFILE(module, call) call
+#define LOOP_PROFILE_BEGIN()
+#define LOOP_PROFILE_END()
+#endif
+
+enum class LoopModule : uint8_t
+{
+    LED = 0,
+    TEMPERATURE = 1,
+    WIFI = 2,
+    MOTOR = 3,
+    UTILITIES = 4,
+    OTA = 5,
+    REMOTE = 6,
+    MQTT = 7,
+    TELNET = 8,
+    EVENTS = 9,
+    LOOP = 10, // The whole loop() pass
+    COUNT = 11
+};
+
+#if LOOP_PROFILER
+// Time spent in each handle() per loop() pass, in CPU cycles. Each module
+// keeps a histogram with one bucket per power of two, bucket b holds
+// durations in [2^(b-1), 2^b), so a percentile is known to within 2x.
+class LoopProfiler
+{
+private:
+    struct ModuleStats
+    {
+        uint32_t buckets[33];
+        uint32_t count;
+        uint32_t maxCycles;
+        uint64_t totalCycles;
+    };
+
+    static ModuleStats stats[(uint8_t)LoopModule::COUNT];
+    static uint32_t loopStart;
+    static unsigned long windowStart; // millis() of the last reset
+
+    static uint32_t getPercentileCycles(const ModuleStats &module, uint8_t percentile);
+    static uint32_t cyclesToMicros(uint64_t cycles);
+
+public:
+    static void record(LoopModule module, uint32_t cycles);
+    static void beginLoop();
+    static void endLoop();
+    static void reset();
+    static void printReport();
+    static size_t formatJson(char *buffer, size_t size);
+    static String getModuleString(LoopModule module);
+};
+
+// Static member definitions
+LoopProfiler::ModuleStats LoopProfiler::stats[(uint8_t)LoopModule::COUNT];
+uint32_t LoopProfiler::loopStart = 0U;
+unsigned long LoopProfiler::windowStart = 0U;
+
+// Private methods
+uint32_t LoopProfiler::getPercentileCycles(const ModuleStats &module, uint8_t percentile)
+{
+    if (module.count == 0)
+    {
+        return 0;
+    }
+
+    uint32_t rank = (uint32_t)(((uint64_t)module.count * percentile + 99) / 100);
+    uint32_t seen = 0;
+    for (uint8_t bucket = 0; bucket < 33; bucket++)
+    {
+        seen += module.buckets[bucket];
+        if (seen >= rank)
+        {
+            // Upper end of the bucket, never more than the worst case seen
+            uint32_t limit = bucket >= 32 ? UINT32_MAX : (1UL << bucket) - 1;
+            return min(limit, module.maxCycles);
+        }
+    }
+
+    return module.maxCycles;
+}
+
+uint32_t LoopProfiler::cyclesToMicros(uint64_t cycles)
+{
+    return (uint32_t)(cycles / getCpuFrequencyMhz());
+}
+
+// Public methods
+void LoopProfiler::record(LoopModule module, uint32_t cycles)
+{
+    ModuleStats &moduleStats = stats[(uint8_t)module];
+    uint8_t bucket = cycles == 0 ? 0 : 32 - __builtin_clz(cycles);
+
+    moduleStats.buckets[bucket]++;
+    moduleStats.count++;
+    moduleStats.totalCycles += cycles;
+    if (cycles > moduleStats.maxCycles)
+    {
+        moduleStats.maxCycles = cycles;
+    }
+}
+
+void LoopProfiler::beginLoop()
+{
+    loopStart = ESP.getCycleCount();
+}
+
+void LoopProfiler::endLoop()
+{
+    record(LoopModule::LOOP, ESP.getCycleCount() - loopStart);
+}
+
+void LoopProfiler::reset()
+{
+    memset(stats, 0, sizeof(stats));
+    windowStart = millis();
+}
+
+void LoopProfiler::printReport()
+{
+    LOG.printf("Loop profile over the last %lu ms (us):\n", millis() - windowStart);
+    LOG.println("module       count      mean    p50    p99    max");
+
+    for (uint8_t i = 0; i < (uint8_t)LoopModule::COUNT; i++)
+    {
+        const ModuleStats &module = stats[i];
+        LOG.printf("%-10s %7u %9u %6u %6u %6u\n",
+                   getModuleString((LoopModule)i).c_str(),
+                   (unsigned int)module.count,
+                   (unsigned int)(module.count > 0 ? cyclesToMicros(module.totalCycles / module.count) : 0),
+                   (unsigned int)cyclesToMicros(getPercentileCycles(module, 50)),
+                   (unsigned int)cyclesToMicros(getPercentileCycles(module, 99)),
+                   (unsigned int)cyclesToMicros(module.maxCycles));
+    }
+}
+
+size_t LoopProfiler::formatJson(char *buffer, size_t size)
+{
+    size_t length = snprintf(buffer, size, "{\"ms\":%lu", millis() - windowStart);
+
+    for (uint8_t i = 0; i < (uint8_t)LoopModule::COUNT && length < size; i++)
+    {
+        const ModuleStats &module = stats[i];
+        length += snprintf(buffer + length, size - length, ",\"%s\":{\"n\":%u,\"p99\":%u,\"max\":%u}",
+                           getModuleString((LoopModule)i).c_str(),
+                           (unsigned int)module.count,
+                           (unsigned int)cyclesToMicros(getPercentileCycles(module, 99)),
+                           (unsigned int)cyclesToMicros(module.maxCycles));
+    }
+
+    if (length < size)
+    {
+        length += snprintf(buffer + length, size - length, "}");
+    }
+
+    return length < size ? length : 0;
+}
+
+String LoopProfiler::getModuleString(LoopModule module)
+{
+    switch (module)
+    {
+    case LoopModule::LED:
+        return String("LED");
+        break;
+
+    case LoopModule::TEMPERATURE:
+        return String("TEMP");
+        break;
+
+    case LoopModule::WIFI:
+        return String("WIFI");
+        break;
+
+    case LoopModule::MOTOR:
+        return String("MOTOR");
+        break;
+
+    case LoopModule::UTILITIES:
+        return String("UTILITIES");
+        break;
+
+    case LoopModule::OTA:
+        return String("OTA");
+        break;
+
+    case LoopModule::REMOTE:
+        return String("REMOTE");
+        break;
+
+    case LoopModule::MQTT:
+        return String("MQTT");
+        break;
+
+    case LoopModule::TELNET:
+        return String("TELNET");
+        break;
+
+    case LoopModule::EVENTS:
+        return String("EVENTS");
+        break;
+
+    case LoopModule::LOOP:
+        return String("LOOP");
+        break;
+
+    default:
+        return String("UNKNOWN");
+        break;
+    }
+}
+#endif
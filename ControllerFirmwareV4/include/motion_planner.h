@@ -0,0 +1,99 @@
+#pragma once
+#include "shared.h"
+
+enum class MotorState : uint8_t
+{
+    STOPPED = 0,
+    CLOSING = 1,
+    OPENING = 2
+};
+
+// Command queued from the loop task to the motion task
+struct MotorCommand
+{
+    MotorState state;      // Direction to move in, or STOPPED. Moves to a target get their direction when they start.
+    uint8_t targetPercent; // Open percentage to stop at, MOTOR_TARGET_ENDSTOP runs into the endstop
+    bool calibrate;        // Learning run, close fully then open fully to measure the travel
+};
+
+// Sits between the command queue and the motion state machine in the motion
+// task. Commands are coalesced into a single pending slot, the latest one
+// wins. A running move is never redirected: it is ramped down first and the
+// pending command starts once the motor is stopped, plus a short dwell when
+// the direction reverses. The worst case latency of a reversal is one
+// deceleration ramp plus MOTION_PLANNER_REVERSAL_DWELL.
+class MotionPlanner
+{
+private:
+    static MotorCommand pending;
+    static bool hasPending;
+    static uint32_t coalescedCount; // Commands replaced before they started
+    static bool lastMoveClosing;
+    static unsigned long lastMoveEnd;
+
+public:
+    static void submit(const MotorCommand &command);
+    static bool peek(MotorCommand &command);
+    static void discard();
+    static bool isPending();
+    static bool isReady(bool closing); // Reversal dwell is over for a move in this direction
+    static void onMoveFinished(bool closing);
+    static uint32_t getCoalescedCount();
+};
+
+// Static member definitions
+MotorCommand MotionPlanner::pending = {MotorState::STOPPED, MOTOR_TARGET_ENDSTOP, false};
+bool MotionPlanner::hasPending = false;
+uint32_t MotionPlanner::coalescedCount = 0U;
+bool MotionPlanner::lastMoveClosing = false;
+unsigned long MotionPlanner::lastMoveEnd = 0U;
+
+// Public methods
+void MotionPlanner::submit(const MotorCommand &command)
+{
+    if (hasPending)
+    {
+        coalescedCount++;
+    }
+
+    pending = command;
+    hasPending = true;
+}
+
+bool MotionPlanner::peek(MotorCommand &command)
+{
+    if (!hasPending)
+    {
+        return false;
+    }
+
+    command = pending;
+    return true;
+}
+
+void MotionPlanner::discard()
+{
+    hasPending = false;
+}
+
+bool MotionPlanner::isPending()
+{
+    return hasPending;
+}
+
+bool MotionPlanner::isReady(bool closing)
+{
+    // Let the window and the coupling settle before pulling the other way
+    return closing == lastMoveClosing || millis() - lastMoveEnd >= MOTION_PLANNER_REVERSAL_DWELL;
+}
+
+void MotionPlanner::onMoveFinished(bool closing)
+{
+    lastMoveClosing = closing;
+    lastMoveEnd = millis();
+}
+
+uint32_t MotionPlanner::getCoalescedCount()
+{
+    return coalescedCount;
+}
@@ -0,0 +1,229 @@
+#pragma once
+#include "shared.h"
+
+// Step intervals for the acceleration ramp, in step timer ticks (1us).
+// Entry i covers ramp steps [i * stepsPerEntry, (i + 1) * stepsPerEntry).
+struct RampTable
+{
+    uint16_t interval[MOTION_RAMP_TABLE_SIZE];
+};
+
+constexpr double rampSqrt(double value)
+{
+    double root = value > 1.0 ? value : 1.0;
+    for (int i = 0; i < 64; i++)
+    {
+        root = 0.5 * (root + value / root);
+    }
+    return root;
+}
+
+// Steps it takes to go from MOTOR_START_SPEED to MOTOR_SPEED
+constexpr uint32_t rampStepCount()
+{
+    double speedSquaredDelta = (double)MOTOR_SPEED * MOTOR_SPEED - (double)MOTOR_START_SPEED * MOTOR_START_SPEED;
+#if MOTION_PROFILE == MOTION_PROFILE_SCURVE
+    // The smoothstep ramp peaks at 1.5x its average acceleration, so it is stretched to keep that peak at MOTOR_ACCEL
+    return (uint32_t)(0.75 * speedSquaredDelta / MOTOR_ACCEL) + 1;
+#else
+    return (uint32_t)(speedSquaredDelta / (2.0 * MOTOR_ACCEL)) + 1;
+#endif
+}
+
+constexpr uint32_t rampStepsPerEntry()
+{
+    return (rampStepCount() + MOTION_RAMP_TABLE_SIZE - 1) / MOTION_RAMP_TABLE_SIZE;
+}
+
+// Speed after covering the given fraction (0 - 1) of the ramp distance
+constexpr double rampSpeedAt(double fraction)
+{
+#if MOTION_PROFILE == MOTION_PROFILE_SCURVE
+    return MOTOR_START_SPEED + (double)(MOTOR_SPEED - MOTOR_START_SPEED) * fraction * fraction * (3.0 - 2.0 * fraction);
+#else
+    return rampSqrt((double)MOTOR_START_SPEED * MOTOR_START_SPEED + ((double)MOTOR_SPEED * MOTOR_SPEED - (double)MOTOR_START_SPEED * MOTOR_START_SPEED) * fraction);
+#endif
+}
+
+constexpr RampTable buildRampTable()
+{
+    RampTable table{};
+    for (uint32_t i = 0; i < MOTION_RAMP_TABLE_SIZE; i++)
+    {
+        // Use the speed in the middle of the steps covered by this entry
+        double fraction = (i + 0.5) * rampStepsPerEntry() / rampStepCount();
+        if (fraction > 1.0)
+        {
+            fraction = 1.0;
+        }
+        table.interval[i] = (uint16_t)(STEP_TIMER_TICKS_PER_SECOND / rampSpeedAt(fraction));
+    }
+    return table;
+}
+
+// Accelerate / cruise / decelerate profile for a single move.
+// nextInterval() is called once per step, from the step ISR for the timer
+// backend, so it only does integer math and a table lookup.
+// All distances are in fine microsteps. A coarse step covers MICROSTEP_RATIO
+// of them, so the step engine passes the size of every step it takes.
+class MotionProfile
+{
+private:
+    static volatile uint32_t rampPosition;   // Steps into the acceleration ramp
+    static volatile uint32_t rampLimit;      // Ramp position where cruise speed is reached
+    static volatile uint32_t coarseRampPosition; // Ramp position from where coarse steps are fast enough
+    static volatile uint32_t stepsRemaining; // Steps left in the move, only written by nextInterval() once started
+    static volatile uint32_t cruiseInterval;
+    static volatile bool stopRequested;
+    static volatile bool approachEndstop; // Creep at the start speed once the distance is covered
+
+    static uint32_t getCruiseInterval(float cruiseSpeed);
+    static uint32_t getRampLimit(uint32_t interval);
+
+public:
+    static const uint32_t UNBOUNDED_MOVE = UINT32_MAX; // Move until an endstop or stop request
+    static constexpr uint32_t rampSteps = rampStepCount();
+    static constexpr uint32_t stepsPerEntry = rampStepsPerEntry();
+    static constexpr RampTable rampTable = buildRampTable();
+
+    static void start(float cruiseSpeed, uint32_t distance = UNBOUNDED_MOVE, bool untilEndstop = false);
+    static void requestStop();
+    static uint32_t IRAM_ATTR nextInterval(uint8_t stepSize = 1); // Ticks until the following step, 0 once the move is finished
+    static bool IRAM_ATTR isCoarseAllowed();
+    static uint32_t getStartInterval();
+    static bool isDecelerating();
+    static unsigned long estimateMillis(float cruiseSpeed, uint32_t distance, uint32_t creepSteps = 0); // Duration of a bounded move
+};
+
+// Static member definitions
+DRAM_ATTR constexpr RampTable MotionProfile::rampTable;
+volatile uint32_t MotionProfile::rampPosition = 0U;
+volatile uint32_t MotionProfile::rampLimit = 0U;
+volatile uint32_t MotionProfile::coarseRampPosition = UINT32_MAX;
+volatile uint32_t MotionProfile::stepsRemaining = 0U;
+volatile uint32_t MotionProfile::cruiseInterval = 0U;
+volatile bool MotionProfile::stopRequested = false;
+volatile bool MotionProfile::approachEndstop = false;
+
+// Private methods
+uint32_t MotionProfile::getCruiseInterval(float cruiseSpeed)
+{
+    return (uint32_t)(STEP_TIMER_TICKS_PER_SECOND / constrain(cruiseSpeed, MOTOR_START_SPEED, MAX_MOTOR_SPEED));
+}
+
+uint32_t MotionProfile::getRampLimit(uint32_t interval)
+{
+    // Stop ramping up at the first entry that is as fast as the cruise speed
+    uint32_t entry = 0;
+    while (entry < MOTION_RAMP_TABLE_SIZE && rampTable.interval[entry] > interval)
+    {
+        entry++;
+    }
+    return entry * stepsPerEntry < rampSteps ? entry * stepsPerEntry : rampSteps;
+}
+
+// Public methods
+void MotionProfile::start(float cruiseSpeed, uint32_t distance, bool untilEndstop)
+{
+    cruiseInterval = getCruiseInterval(cruiseSpeed);
+    rampLimit = getRampLimit(cruiseInterval);
+
+    // Coarse steps only once the fine step rate would be above MICROSTEP_COARSE_SPEED
+    uint32_t entry = 0;
+    while (entry < MOTION_RAMP_TABLE_SIZE && rampTable.interval[entry] > STEP_TIMER_TICKS_PER_SECOND / MICROSTEP_COARSE_SPEED)
+    {
+        entry++;
+    }
+    coarseRampPosition = entry < MOTION_RAMP_TABLE_SIZE ? entry * stepsPerEntry : UINT32_MAX;
+
+    rampPosition = 0;
+    stepsRemaining = distance;
+    stopRequested = false;
+    approachEndstop = untilEndstop;
+}
+
+void MotionProfile::requestStop()
+{
+    stopRequested = true;
+}
+
+uint32_t IRAM_ATTR MotionProfile::nextInterval(uint8_t stepSize)
+{
+    if (stopRequested && stepsRemaining > rampPosition)
+    {
+        // Just enough steps left to ramp back down
+        stepsRemaining = rampPosition;
+    }
+
+    if (stepsRemaining == 0)
+    {
+        if (approachEndstop && !stopRequested)
+        {
+            // Ramped down short of the expected endstop, creep until it triggers
+            return rampTable.interval[0] * stepSize;
+        }
+        return 0;
+    }
+
+    if (stepsRemaining != UNBOUNDED_MOVE)
+    {
+        stepsRemaining = stepsRemaining > stepSize ? stepsRemaining - stepSize : 0;
+    }
+
+    if (stepsRemaining <= rampPosition)
+    {
+        // Decelerate
+        rampPosition = rampPosition > stepSize ? rampPosition - stepSize : 0;
+    }
+    else if (rampPosition < rampLimit)
+    {
+        // Accelerate
+        rampPosition = rampPosition + stepSize < rampLimit ? rampPosition + stepSize : rampLimit;
+    }
+
+    if (rampPosition >= rampLimit)
+    {
+        return cruiseInterval * stepSize;
+    }
+
+    return rampTable.interval[rampPosition / stepsPerEntry] * stepSize;
+}
+
+bool IRAM_ATTR MotionProfile::isCoarseAllowed()
+{
+    // Unbounded moves end at an endstop nobody knows the distance to, keep those fine
+    return rampPosition >= coarseRampPosition && stepsRemaining != UNBOUNDED_MOVE && stepsRemaining > MICROSTEP_FINE_ZONE;
+}
+
+uint32_t MotionProfile::getStartInterval()
+{
+    return rampTable.interval[0];
+}
+
+bool MotionProfile::isDecelerating()
+{
+    return stopRequested || stepsRemaining <= rampPosition;
+}
+
+unsigned long MotionProfile::estimateMillis(float cruiseSpeed, uint32_t distance, uint32_t creepSteps)
+{
+    uint32_t interval = getCruiseInterval(cruiseSpeed);
+
+    // Short moves turn around halfway up the ramp. Coarse steps take as long as
+    // the fine steps they cover, so everything is counted in fine steps.
+    uint32_t ramp = getRampLimit(interval);
+    if (ramp > distance / 2)
+    {
+        ramp = distance / 2;
+    }
+    uint64_t ticks = 0;
+    for (uint32_t step = 0; step < ramp; step += stepsPerEntry)
+    {
+        uint32_t steps = ramp - step < stepsPerEntry ? ramp - step : stepsPerEntry;
+        ticks += 2ULL * steps * rampTable.interval[step / stepsPerEntry]; // Up and down
+    }
+    ticks += (uint64_t)(distance - 2 * ramp) * interval;
+    ticks += (uint64_t)creepSteps * rampTable.interval[0];
+
+    return (unsigned long)(ticks * 1000ULL / (uint64_t)STEP_TIMER_TICKS_PER_SECOND);
+}
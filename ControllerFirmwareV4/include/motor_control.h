@@ -1,26 +1,34 @@
 #pragma once
 #include "shared.h"
 #include "led_control.h"
-
-enum class WindowState : uint8_t
-{
-    NONE = 0,
-    CLOSING = 1,
-    OPENING = 2,
-    CLOSED = 3,
-    OPEN = 4,
-    CLOSING_ERROR = 5,
-    OPENING_ERROR = 6,
-    UPDATING = 7,
-    UPDATE_COMPLETE = 8,
-    RESTARTING = 9
+#include "step_engine.h"
+#include "spsc_queue.h"
+#include "travel_model.h"
+#include "endstop_control.h"
+#include "motion_planner.h"
+#include "event_bus.h"
+#include "binary_log.h"
+
+enum class MoveEndReason : uint8_t
+{
+    ENDSTOP = 0,
+    TARGET = 1,
+    TIMEOUT = 2,
+    STOPPED = 3
 };
 
-enum class MotorState : uint8_t
+// Telemetry for one move, gaps are between step pulses
+struct MoveRecord
 {
-    STOPPED = 0,
-    CLOSING = 1,
-    OPENING = 2
+    bool closing;
+    MoveEndReason reason;
+    unsigned long startMillis;
+    unsigned long endMillis;
+    uint32_t steps;
+    uint32_t maxGapMicros;
+    uint32_t p99GapMicros;
+    uint32_t maxPassMicros; // Longest motion task pass, bounds the time between two polled steps
+    uint32_t passOverruns;  // Passes over MOTION_PASS_BUDGET_US, command handling waits a pass after those
 };
 
 class MotorControl
@@ -29,30 +37,80 @@ private:
     static bool motorEnabled;
     static bool triggered;
     static unsigned long lastMovementStart;
-    static MotorState requestedMotorState;
-    static WindowState currentWindowState;
+    static unsigned long moveTimeLimit;  // Learned from TravelModel, MOTOR_RUN_TIMEOUT until trained
+    static uint32_t moveStepLimit;
+    static int32_t moveStartPosition;
+    static uint32_t maxPassCycles; // Motion task passes during the current move
+    static uint32_t passOverruns;
+    static uint32_t passBudgetCycles;
+    static uint32_t moveDistance;        // Distance the motion profile was planned for
+    static bool moveFromEndstop;         // Planned move from the opposite endstop, a full travel sample
+    static MoveEndReason moveEndReason;
+    static std::atomic<MotorState> requestedMotorState;
+    static std::atomic<WindowState> currentWindowState;
+
+    // Position tracking, positions are steps from the closed endstop
+    static uint8_t requestedTargetPercent;
+    static bool calibrating;
+    static bool homedAtClosed;               // Closed endstop seen since the position was last lost
+    static std::atomic<bool> positionKnown;
+    static std::atomic<int32_t> travelSteps; // Learned steps between the endstops, 0 if unknown
+    static std::atomic<bool> travelChanged;  // Learned travel needs to be saved
+
+    // Motion task and the queues connecting it to the loop task
+    static TaskHandle_t motionTaskHandle;
+    static SpscQueue<MotorCommand, MOTOR_COMMAND_QUEUE_SIZE> commandQueue;  // Loop task -> motion task
+    static SpscQueue<MoveRecord, MOTOR_MOVE_QUEUE_SIZE> moveRecordQueue;    // Motion task -> loop task
+
+    // Ring buffer of the last moves, only touched by the loop task
+    static MoveRecord moveLog[MOTOR_MOVE_LOG_SIZE];
+    static uint32_t moveLogTotal; // Moves recorded since boot
 
     static void InitialWindowSetup();
+    static void motionTask(void *parameter);
+    static void recordPass(uint32_t cycles);
+    static void HandleMotorCommands();
+    static bool resolveCommand(MotorCommand &command); // False if there is nothing to do
+    static void applyCommand(MotorCommand command);
     static void HandleMotorState();
+    static int32_t getTargetPosition(uint8_t percent);
+    static void startMove(bool closing);
+    static uint32_t getStepsMoved();
+    static bool isMoveOverLimit();
+    static void recordMove();
+    static void rebasePosition(int32_t newPosition); // Keeps the steps moved so far intact
+    static void onClosedEndstopReached();
+    static void onOpenEndstopReached();
+    static void onMoveError();
+    static void postWindowState(WindowState newState); // Motion task side of a state change
+    static void onEvent(const Event &event);           // Logs window state changes
+    static void queueCommand(MotorCommand command);
+    static void loadTravel();
+    static void saveTravel();
     static void enableStepper();            // Enable stepper power
     static void disableStepper();           // Disable stepper power
     static bool isOpenEndstopTriggered();   // Is the open endstop triggered
     static bool isClosedEndstopTriggered(); // Is the closed endstop triggered
 
-    
+
 
 public:
     static void begin();
     static void handle();
 
-    static void (*onWindowStateChange)(WindowState *curWindowState);
-    static void setWindowStateChangeCallback(void (*func)(WindowState *curWindowState));
-
     static bool isMotorMoving();
     static WindowState getCurrentWindowState();
     static MotorState getRequestedMotorState();
     static void setCurrentWindowState(WindowState newState);
     static void setRequestedMotorState(MotorState requestedState);
+    static void setRequestedPosition(int percent); // Move to a percentage open, 0 = closed, 100 = open
+    static void requestCalibration();
+    static bool isPositionKnown();
+    static int getPositionPercent(); // -1 if the position is unknown
+    static uint32_t getMoveLogTotal();
+    static bool getMoveRecord(uint32_t sequence, MoveRecord &record); // False once it has been overwritten
+    static void printMoveLog();
+    static String getMoveEndReasonString(MoveEndReason reason);
     static String getWindowStateString(WindowState state);
     static String getMotorStateString(MotorState state);
 };
@@ -62,20 +120,41 @@ public:
 bool MotorControl::motorEnabled = false;
 bool MotorControl::triggered = false;
 unsigned long MotorControl::lastMovementStart = 0U;
-MotorState MotorControl::requestedMotorState = MotorState::STOPPED;
-WindowState MotorControl::currentWindowState = WindowState::NONE;
+unsigned long MotorControl::moveTimeLimit = MOTOR_RUN_TIMEOUT;
+uint32_t MotorControl::moveStepLimit = UINT32_MAX;
+int32_t MotorControl::moveStartPosition = 0;
+uint32_t MotorControl::maxPassCycles = 0U;
+uint32_t MotorControl::passOverruns = 0U;
+uint32_t MotorControl::passBudgetCycles = 0U;
+uint32_t MotorControl::moveDistance = MotionProfile::UNBOUNDED_MOVE;
+bool MotorControl::moveFromEndstop = false;
+MoveEndReason MotorControl::moveEndReason = MoveEndReason::STOPPED;
+std::atomic<MotorState> MotorControl::requestedMotorState(MotorState::STOPPED);
+std::atomic<WindowState> MotorControl::currentWindowState(WindowState::NONE);
+uint8_t MotorControl::requestedTargetPercent = MOTOR_TARGET_ENDSTOP;
+bool MotorControl::calibrating = false;
+bool MotorControl::homedAtClosed = false;
+std::atomic<bool> MotorControl::positionKnown(false);
+std::atomic<int32_t> MotorControl::travelSteps(0);
+std::atomic<bool> MotorControl::travelChanged(false);
+TaskHandle_t MotorControl::motionTaskHandle = NULL;
+SpscQueue<MotorCommand, MOTOR_COMMAND_QUEUE_SIZE> MotorControl::commandQueue;
+SpscQueue<MoveRecord, MOTOR_MOVE_QUEUE_SIZE> MotorControl::moveRecordQueue;
+MoveRecord MotorControl::moveLog[MOTOR_MOVE_LOG_SIZE];
+uint32_t MotorControl::moveLogTotal = 0U;
 
-void (*MotorControl::onWindowStateChange)(WindowState *curWindowState) = NULL;
 
 // Private methods
 void MotorControl::InitialWindowSetup()
 {
     if (isOpenEndstopTriggered())
     {
+        onOpenEndstopReached();
         setCurrentWindowState(WindowState::OPEN);
     }
     else if (isClosedEndstopTriggered())
     {
+        onClosedEndstopReached();
         setCurrentWindowState(WindowState::CLOSED);
     }
     else
@@ -88,22 +167,24 @@ void MotorControl::InitialWindowSetup()
             bool running = true;
             LedControl::setStatusLedColor(StatusColors::HOMING);
             lastMovementStart = millis();
-            stepper.setSpeed(MOTOR_SPEED);
+            StepEngine::setSpeed(MOTOR_SPEED);
+            StepEngine::start();
             while (running)
             {
-                stepper.runSpeed();
+                StepEngine::run();
 
                 if (isClosedEndstopTriggered())
                 {
-                    stepper.stop();
+                    StepEngine::stop();
                     LOG.println("Window initially closed.");
+                    onClosedEndstopReached();
                     setCurrentWindowState(WindowState::CLOSED);
                     running = false;
                 }
 
                 if (millis() - lastMovementStart >= MOTOR_RUN_TIMEOUT)
                 {
-                    stepper.stop();
+                    StepEngine::stop();
                     LOG.println("Endstop has not been reached yet, stopping. Check window.");
                     setCurrentWindowState(WindowState::CLOSING_ERROR);
                     running = false;
@@ -116,6 +197,227 @@ void MotorControl::InitialWindowSetup()
     }
 }
 
+void MotorControl::motionTask(void *parameter)
+{
+    bool commandsDeferred = false;
+
+    for (;;)
+    {
+        // Nothing in a pass may block, logging, LED and MQTT work is queued
+        // for the loop task, so a pass is what bounds the gap between steps
+        uint32_t passStart = ESP.getCycleCount();
+        if (!triggered)
+        {
+            // Idle, a queued command can start its move in this pass
+            HandleMotorCommands();
+        }
+
+        HandleMotorState();
+
+        if (triggered)
+        {
+            // Commands during a move only ramp it down, so they wait for a
+            // pass that stepped and checked the endstops within its budget.
+            // Never more than one pass, a stop must not starve.
+            commandsDeferred = !commandsDeferred && ESP.getCycleCount() - passStart >= passBudgetCycles;
+            if (!commandsDeferred)
+            {
+                HandleMotorCommands();
+            }
+            recordPass(ESP.getCycleCount() - passStart);
+        }
+
+        if (!triggered && !MotionPlanner::isPending())
+        {
+            // Idle, sleep until a command is queued
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MOTION_TASK_IDLE_WAIT));
+        }
+        else if (!StepEngine::requiresLoop || !triggered)
+        {
+            // Pulses come from the step engine or a command waits out the
+            // reversal dwell, only endstops and timeouts are checked here
+            vTaskDelay(1);
+        }
+        else
+        {
+            // The polled backend spins for the whole move at the loop task's
+            // priority, so the two take turns and stops from telnet, the
+            // remote and MQTT still get through
+            yield();
+        }
+    }
+}
+
+void MotorControl::recordPass(uint32_t cycles)
+{
+    if (cycles > maxPassCycles)
+    {
+        maxPassCycles = cycles;
+    }
+
+    if (cycles > passBudgetCycles)
+    {
+        passOverruns++;
+    }
+}
+
+void MotorControl::HandleMotorCommands()
+{
+    MotorCommand command;
+
+    // Only the latest command counts, bursts collapse into the pending slot
+    while (commandQueue.pop(command))
+    {
+        MotionPlanner::submit(command);
+    }
+
+    if (!MotionPlanner::peek(command))
+    {
+        return;
+    }
+
+    if (triggered)
+    {
+        bool sameMove = !command.calibrate && command.state != MotorState::STOPPED && requestedMotorState != MotorState::STOPPED && command.targetPercent == requestedTargetPercent && (command.targetPercent != MOTOR_TARGET_ENDSTOP || command.state == requestedMotorState);
+        if (sameMove || (command.state == MotorState::STOPPED && !command.calibrate))
+        {
+            // Either already doing it or a stop, which the stop branch carries out
+            MotionPlanner::discard();
+        }
+
+        if (!sameMove)
+        {
+            // Ramp the running move down, a pending move starts once the motor is stopped
+            requestedMotorState = MotorState::STOPPED;
+        }
+        return;
+    }
+
+    if (!resolveCommand(command))
+    {
+        MotionPlanner::discard();
+        return;
+    }
+
+    if (!MotionPlanner::isReady(command.state == MotorState::CLOSING))
+    {
+        // Still in the reversal dwell, stays pending
+        return;
+    }
+
+    MotionPlanner::discard();
+    applyCommand(command);
+}
+
+bool MotorControl::resolveCommand(MotorCommand &command)
+{
+    if (command.calibrate)
+    {
+        command.state = MotorState::CLOSING;
+        command.targetPercent = MOTOR_TARGET_ENDSTOP;
+        return true;
+    }
+
+    if (command.state == MotorState::STOPPED)
+    {
+        return false;
+    }
+
+    if (command.targetPercent != MOTOR_TARGET_ENDSTOP)
+    {
+        if (!isPositionKnown())
+        {
+            return false;
+        }
+
+        // The window may have moved since the command was sent, take the direction from where it is now
+        int32_t target = getTargetPosition(command.targetPercent);
+        int32_t position = StepEngine::getPosition();
+        if (target == position)
+        {
+            return false;
+        }
+        command.state = target < position ? MotorState::CLOSING : MotorState::OPENING;
+    }
+
+    return true;
+}
+
+void MotorControl::applyCommand(MotorCommand command)
+{
+    if (command.calibrate)
+    {
+        // Home on the closed endstop first, the open endstop then gives the travel
+        calibrating = true;
+        homedAtClosed = false;
+        TravelModel::reset();
+    }
+
+    if (command.state == MotorState::OPENING && isOpenEndstopTriggered())
+    {
+        // Window is already open
+        onOpenEndstopReached();
+        requestedMotorState = MotorState::STOPPED;
+        postWindowState(WindowState::OPEN);
+    }
+    else if (command.state == MotorState::CLOSING && isClosedEndstopTriggered())
+    {
+        // Window is already closed
+        onClosedEndstopReached();
+        requestedMotorState = calibrating ? MotorState::OPENING : MotorState::STOPPED;
+        requestedTargetPercent = MOTOR_TARGET_ENDSTOP;
+        postWindowState(WindowState::CLOSED);
+    }
+    else
+    {
+        requestedTargetPercent = command.targetPercent;
+        requestedMotorState = command.state;
+    }
+}
+
+void MotorControl::startMove(bool closing)
+{
+    uint32_t distance = MotionProfile::UNBOUNDED_MOVE;
+    uint32_t expectedSteps = TRAVEL_MODEL_FULL_MOVE;
+    bool untilEndstop = false;
+
+    if (requestedTargetPercent != MOTOR_TARGET_ENDSTOP)
+    {
+        int32_t target = getTargetPosition(requestedTargetPercent);
+        int32_t remaining = closing ? StepEngine::getPosition() - target : target - StepEngine::getPosition();
+        distance = remaining > 0 ? remaining : 0;
+        expectedSteps = distance;
+    }
+    else if (isPositionKnown())
+    {
+        int32_t remaining = closing ? StepEngine::getPosition() : travelSteps - StepEngine::getPosition();
+        expectedSteps = remaining > 0 ? remaining : TRAVEL_MODEL_FULL_MOVE;
+
+        // Ramp down just short of where the endstop should be and creep into it in fine steps
+        distance = remaining > MOTOR_ENDSTOP_APPROACH ? remaining - MOTOR_ENDSTOP_APPROACH : 0;
+        untilEndstop = true;
+    }
+
+    // Abort once the move runs past what the learned model expects. The time
+    // limit follows the ramp and the creep into the endstop, not just the distance.
+    moveTimeLimit = TravelModel::getTimeLimit(closing, distance, expectedSteps);
+    moveStepLimit = TravelModel::getStepLimit(closing, expectedSteps);
+    moveStartPosition = StepEngine::getPosition();
+    moveDistance = distance;
+    maxPassCycles = 0;
+    passOverruns = 0;
+    // Unbounded moves cruise into the endstop without ramping down, they would skew the samples
+    moveFromEndstop = untilEndstop && (closing ? isOpenEndstopTriggered() : isClosedEndstopTriggered());
+    moveEndReason = MoveEndReason::STOPPED;
+
+    enableStepper();
+    StepEngine::setSpeed(closing ? MOTOR_SPEED : -MOTOR_SPEED);
+    StepEngine::start(distance, untilEndstop);
+    postWindowState(closing ? WindowState::CLOSING : WindowState::OPENING);
+    lastMovementStart = millis();
+    triggered = true;
+}
+
 void MotorControl::HandleMotorState()
 {
     if (requestedMotorState == MotorState::CLOSING)
@@ -123,33 +425,51 @@ void MotorControl::HandleMotorState()
         // Run this once
         if (!triggered)
         {
-            enableStepper();
-            LOG.println("Closing window...");
-            setCurrentWindowState(WindowState::CLOSING);
-            stepper.setSpeed(MOTOR_SPEED);
-            LedControl::setStatusLedColor(StatusColors::CLOSING);
-            LedControl::setLedDimTemp(false); // Temp disable led dimming
-            lastMovementStart = millis();
-            triggered = true;
+            startMove(true);
         }
 
         // Runs while motor state is CLOSING
-        stepper.runSpeed();
+        StepEngine::run();
 
         // End
         if (isClosedEndstopTriggered())
         {
-            LOG.println("Window closed.");
-            setCurrentWindowState(WindowState::CLOSED);
+            StepEngine::stop();
+            if (moveFromEndstop)
+            {
+                TravelModel::record(true, moveDistance, getStepsMoved(), millis() - lastMovementStart);
+            }
+            onClosedEndstopReached();
+            postWindowState(WindowState::CLOSED);
+            moveEndReason = MoveEndReason::ENDSTOP;
+
+            if (calibrating)
+            {
+                // Keep going, the second half of the learning run opens the window
+                recordMove();
+                triggered = false;
+                requestedTargetPercent = MOTOR_TARGET_ENDSTOP;
+                requestedMotorState = MotorState::OPENING;
+            }
+            else
+            {
+                requestedMotorState = MotorState::STOPPED;
+            }
+        }
+        // Reached the requested position
+        else if (!StepEngine::isRunning() && requestedTargetPercent != MOTOR_TARGET_ENDSTOP)
+        {
+            postWindowState(WindowState::PARTIALLY_OPEN);
+            moveEndReason = MoveEndReason::TARGET;
             requestedMotorState = MotorState::STOPPED;
         }
-
         // End with error
-        if (millis() - lastMovementStart >= MOTOR_RUN_TIMEOUT)
+        else if (isMoveOverLimit())
         {
-            LOG.println("Endstop has not been reached yet, stopping. Check window.");
-            LedControl::setErrorHasOccured(true, ErrorCode::MOTOR_ENDSTOP_ERROR);
-            setCurrentWindowState(WindowState::CLOSING_ERROR);
+            StepEngine::stop();
+            onMoveError();
+            postWindowState(WindowState::CLOSING_ERROR);
+            moveEndReason = MoveEndReason::TIMEOUT;
             requestedMotorState = MotorState::STOPPED;
         }
     }
@@ -158,33 +478,39 @@ void MotorControl::HandleMotorState()
         // Run this once
         if (!triggered)
         {
-            enableStepper();
-            LOG.println("Opening window...");
-            setCurrentWindowState(WindowState::OPENING);
-            stepper.setSpeed(-MOTOR_SPEED);
-            LedControl::setStatusLedColor(StatusColors::OPENING);
-            LedControl::setLedDimTemp(false); // Temp disable led dimming
-            lastMovementStart = millis();
-            triggered = true;
+            startMove(false);
         }
 
         // Runs while motor state is OPENING
-        stepper.runSpeed();
+        StepEngine::run();
 
         // End
         if (isOpenEndstopTriggered())
         {
-            LOG.println("Window opened.");
-            setCurrentWindowState(WindowState::OPEN);
+            StepEngine::stop();
+            if (moveFromEndstop)
+            {
+                TravelModel::record(false, moveDistance, getStepsMoved(), millis() - lastMovementStart);
+            }
+            onOpenEndstopReached();
+            postWindowState(WindowState::OPEN);
+            moveEndReason = MoveEndReason::ENDSTOP;
+            requestedMotorState = MotorState::STOPPED;
+        }
+        // Reached the requested position
+        else if (!StepEngine::isRunning() && requestedTargetPercent != MOTOR_TARGET_ENDSTOP)
+        {
+            postWindowState(WindowState::PARTIALLY_OPEN);
+            moveEndReason = MoveEndReason::TARGET;
             requestedMotorState = MotorState::STOPPED;
         }
-
         // End with error
-        if (millis() - lastMovementStart >= MOTOR_RUN_TIMEOUT)
+        else if (isMoveOverLimit())
         {
-            LOG.println("Endstop has not been reached yet, stopping. Check window.");
-            LedControl::setErrorHasOccured(true, ErrorCode::MOTOR_ENDSTOP_ERROR);
-            setCurrentWindowState(WindowState::OPENING_ERROR);
+            StepEngine::stop();
+            onMoveError();
+            postWindowState(WindowState::OPENING_ERROR);
+            moveEndReason = MoveEndReason::TIMEOUT;
             requestedMotorState = MotorState::STOPPED;
         }
     }
@@ -193,19 +519,173 @@ void MotorControl::HandleMotorState()
         // If stopped or anything else
         if (triggered)
         {
+            if (StepEngine::isRunning())
+            {
+                // Ramp down before cutting power, an endstop still ends the move right away
+                if (StepEngine::isClosing() ? isClosedEndstopTriggered() : isOpenEndstopTriggered())
+                {
+                    StepEngine::stop();
+                }
+                else
+                {
+                    StepEngine::decelerate();
+                    StepEngine::run();
+                    return;
+                }
+            }
+
+            StepEngine::stop();
+            recordMove();
             triggered = false;
+            calibrating = false;
             disableStepper();
-            stepper.stop();
-            
-            if (currentWindowState != WindowState::CLOSED && currentWindowState != WindowState::OPEN && currentWindowState != WindowState::CLOSING_ERROR && currentWindowState != WindowState::OPENING_ERROR)
+            MotionPlanner::onMoveFinished(StepEngine::isClosing());
+
+            WindowState state = currentWindowState;
+            if (state != WindowState::CLOSED && state != WindowState::OPEN && state != WindowState::PARTIALLY_OPEN && state != WindowState::CLOSING_ERROR && state != WindowState::OPENING_ERROR)
             {
-                setCurrentWindowState(WindowState::NONE);
+                postWindowState(positionKnown ? WindowState::PARTIALLY_OPEN : WindowState::NONE);
             }
+        }
+    }
+}
 
-            LedControl::setBaseStatus();
-            LedControl::setLedDimTemp(true); // Re-enable led dimming
+int32_t MotorControl::getTargetPosition(uint8_t percent)
+{
+    return (int32_t)((int64_t)travelSteps * percent / 100);
+}
+
+uint32_t MotorControl::getStepsMoved()
+{
+    return abs(StepEngine::getPosition() - moveStartPosition);
+}
+
+bool MotorControl::isMoveOverLimit()
+{
+    return millis() - lastMovementStart >= moveTimeLimit || getStepsMoved() > moveStepLimit;
+}
+
+void MotorControl::recordMove()
+{
+    MoveRecord record = {StepEngine::isClosing(), moveEndReason, lastMovementStart, millis(), getStepsMoved(), StepEngine::getMaxGap(), StepEngine::getGapPercentile(99), maxPassCycles / getCpuFrequencyMhz(), passOverruns};
+
+    // Dropped if the loop task has fallen that far behind
+    moveRecordQueue.push(record);
+}
+
+void MotorControl::rebasePosition(int32_t newPosition)
+{
+    moveStartPosition += newPosition - StepEngine::getPosition();
+    StepEngine::setPosition(newPosition);
+}
+
+void MotorControl::onClosedEndstopReached()
+{
+    // The closed endstop is the position reference
+    rebasePosition(0);
+    positionKnown = true;
+    homedAtClosed = true;
+}
+
+void MotorControl::onOpenEndstopReached()
+{
+    if (homedAtClosed)
+    {
+        // Full travel from the closed endstop, learn it. Small run to run
+        // differences are ignored unless calibrating to save flash writes.
+        int32_t measured = StepEngine::getPosition();
+        int32_t difference = abs(measured - travelSteps);
+        if (calibrating || travelSteps <= 0 || difference > travelSteps / 100)
+        {
+            travelSteps = measured;
+            travelChanged = true;
         }
     }
+    else if (travelSteps > 0)
+    {
+        rebasePosition(travelSteps);
+        positionKnown = true;
+    }
+
+    calibrating = false;
+}
+
+void MotorControl::onMoveError()
+{
+    // Steps may have been lost against whatever stopped the window
+    positionKnown = false;
+    homedAtClosed = false;
+    calibrating = false;
+
+    EventBus::publishFromMotion(Event::errorOccured(ErrorCode::MOTOR_ENDSTOP_ERROR));
+}
+
+void MotorControl::postWindowState(WindowState newState)
+{
+    currentWindowState = newState;
+
+    // Logging, LED and MQTT are handled by the subscribers in the loop task
+    EventBus::publishFromMotion(Event::windowStateChanged(newState));
+}
+
+void MotorControl::onEvent(const Event &event)
+{
+    switch (event.windowState)
+    {
+    case WindowState::CLOSING:
+        LOG_EVENT("Closing window...\n");
+        break;
+
+    case WindowState::OPENING:
+        LOG_EVENT("Opening window...\n");
+        break;
+
+    case WindowState::CLOSING_ERROR:
+    case WindowState::OPENING_ERROR:
+        LOG_EVENT("Endstop has not been reached yet, stopping. Check window.\n");
+        break;
+
+    case WindowState::PARTIALLY_OPEN:
+        LOG_EVENT("Window stopped at %d%% open.\n", getPositionPercent());
+        break;
+
+    default:
+        break;
+    }
+
+    LOG_EVENT("New window state is %s\n", getWindowStateString(event.windowState).c_str());
+}
+
+void MotorControl::queueCommand(MotorCommand command)
+{
+    if (!commandQueue.push(command))
+    {
+        LOG_EVENT("Motor command queue is full, command dropped.\n");
+        return;
+    }
+
+    if (motionTaskHandle != NULL)
+    {
+        xTaskNotifyGive(motionTaskHandle);
+    }
+}
+
+void MotorControl::loadTravel()
+{
+    preferences.begin(MOTOR_PREFERENCES_NAMESPACE, true);
+    travelSteps = preferences.getInt("travel", 0);
+    preferences.end();
+
+    LOG_EVENT("Learned window travel is %d steps.\n", (int)travelSteps);
+}
+
+void MotorControl::saveTravel()
+{
+    preferences.begin(MOTOR_PREFERENCES_NAMESPACE, false);
+    preferences.putInt("travel", travelSteps);
+    preferences.end();
+
+    LOG_EVENT("Learned window travel of %d steps saved.\n", (int)travelSteps);
 }
 
 void MotorControl::enableStepper()
@@ -222,68 +702,66 @@ void MotorControl::disableStepper()
 
 bool MotorControl::isOpenEndstopTriggered()
 {
-    return !digitalRead(OPEN_ENDSTOP_PIN);
+    return Endstops::isTriggered(Endstop::OPEN);
 }
 
 bool MotorControl::isClosedEndstopTriggered()
 {
-    return !digitalRead(CLOSE_ENDSTOP_PIN);
-}
-
-void MotorControl::setCurrentWindowState(WindowState newState)
-{
-    currentWindowState = newState;
-
-    // State change function callback for mqtt
-    if (onWindowStateChange != NULL)
-    {
-        onWindowStateChange(&currentWindowState);
-    }
-
-    LOG.print("New window state is ");
-    LOG.println(getWindowStateString(currentWindowState));
+    return Endstops::isTriggered(Endstop::CLOSED);
 }
 
 // Public methods
 void MotorControl::begin()
 {
     pinMode(ENABLE_PIN, OUTPUT);
+    passBudgetCycles = MOTION_PASS_BUDGET_US * getCpuFrequencyMhz();
 
-    pinMode(MICRO_PIN_1, OUTPUT);
-    digitalWrite(MICRO_PIN_1, HIGH);
-
-    pinMode(MICRO_PIN_2, OUTPUT);
-    digitalWrite(MICRO_PIN_2, HIGH);
-
-    pinMode(MICRO_PIN_3, OUTPUT);
-    digitalWrite(MICRO_PIN_3, LOW);
+    EventBus::subscribe(EventType::WINDOW_STATE, onEvent);
 
-    pinMode(OPEN_ENDSTOP_PIN, INPUT_PULLUP);
-    pinMode(CLOSE_ENDSTOP_PIN, INPUT_PULLUP);
-
-    // Initialize motor
+    // Initialize motor, the step engine owns the microstep pins
     disableStepper();
-    stepper = AccelStepper(1, STEP_PIN, DIR_PIN);
-
-    stepper.setMaxSpeed(MAX_MOTOR_SPEED);
-    stepper.setSpeed(MOTOR_SPEED);
+    StepEngine::begin();
+    Endstops::begin();
+    loadTravel();
+    TravelModel::begin();
 
     InitialWindowSetup();
+
+    // Everything that touches the motor from here on runs in the motion task
+    UBaseType_t priority = StepEngine::requiresLoop ? MOTION_TASK_POLLED_PRIORITY : MOTION_TASK_PRIORITY;
+    xTaskCreatePinnedToCore(motionTask, "motion", MOTION_TASK_STACK_SIZE, NULL, priority, &motionTaskHandle, MOTION_TASK_CORE);
 }
 
 void MotorControl::handle()
 {
-    HandleMotorState();
-}
+    MoveRecord record;
+    while (moveRecordQueue.pop(record))
+    {
+        moveLog[moveLogTotal % MOTOR_MOVE_LOG_SIZE] = record;
+        moveLogTotal++;
 
- void MotorControl::setWindowStateChangeCallback(void (*func)(WindowState *curWindowState))
- {
-     onWindowStateChange = func;
- }
+        if (record.passOverruns > 0)
+        {
+            LOG_EVENT("Motion task went over its %u us budget %u times during the last move, worst pass %u us.\n", MOTION_PASS_BUDGET_US, (unsigned int)record.passOverruns, (unsigned int)record.maxPassMicros);
+        }
+    }
+
+    if (travelChanged && !isMotorMoving())
+    {
+        travelChanged = false;
+        saveTravel();
+    }
+
+    if (!isMotorMoving())
+    {
+        TravelModel::saveIfChanged();
+    }
+}
 
 bool MotorControl::isMotorMoving()
 {
-    return (currentWindowState == WindowState::CLOSING || currentWindowState == WindowState::OPENING);
+    WindowState state = currentWindowState;
+    return (state == WindowState::CLOSING || state == WindowState::OPENING);
 }
 
 MotorState MotorControl::getRequestedMotorState()
@@ -296,43 +774,79 @@ WindowState MotorControl::getCurrentWindowState()
     return currentWindowState;
 }
 
+void MotorControl::setCurrentWindowState(WindowState newState)
+{
+    currentWindowState = newState;
+    EventBus::publish(Event::windowStateChanged(newState));
+}
+
 void MotorControl::setRequestedMotorState(MotorState requestedState)
 {
-    LOG.print("Requested motor state is ");
-    LOG.println(getMotorStateString(requestedState));
-    if (requestedState == MotorState::OPENING)
+    LOG_EVENT("Requested motor state is %s\n", getMotorStateString(requestedState).c_str());
+
+    if (requestedState != MotorState::OPENING && requestedState != MotorState::CLOSING)
     {
-        // Check if window is already open
-        if (!isOpenEndstopTriggered())
-        {
-            requestedMotorState = requestedState;
-        }
-        else
-        {
-            LOG.println("Window is already open.");
-            requestedMotorState = MotorState::STOPPED;
-            setCurrentWindowState(WindowState::OPEN);
-        }
+        LOG_EVENT("Stopping window.\n");
+        requestedState = MotorState::STOPPED;
     }
-    else if (requestedState == MotorState::CLOSING)
+
+    queueCommand({requestedState, MOTOR_TARGET_ENDSTOP, false});
+}
+
+void MotorControl::setRequestedPosition(int percent)
+{
+    LOG_EVENT("Requested position is %d%% open.\n", percent);
+
+    // The endstops are the reference for both ends
+    if (percent >= 100)
     {
-        // Check if window is already closed
-        if (!isClosedEndstopTriggered())
-        {
-            requestedMotorState = requestedState;
-        }
-        else
-        {
-            LOG.println("Window is already closed.");
-            requestedMotorState = MotorState::STOPPED;
-            setCurrentWindowState(WindowState::CLOSED);
-        }
+        setRequestedMotorState(MotorState::OPENING);
+        return;
     }
-    else
+
+    if (percent <= 0)
     {
-        LOG.println("Stopping window.");
-        requestedMotorState = MotorState::STOPPED;
+        setRequestedMotorState(MotorState::CLOSING);
+        return;
+    }
+
+    if (!isPositionKnown())
+    {
+        LOG_EVENT("Window position is unknown, fully open or close the window or run a calibration first.\n");
+        return;
     }
+
+    int currentPercent = getPositionPercent();
+    if (percent == currentPercent && !isMotorMoving())
+    {
+        LOG_EVENT("Window is already at the requested position.\n");
+        return;
+    }
+
+    // The motion task picks the direction when the move starts
+    queueCommand({percent > currentPercent ? MotorState::OPENING : MotorState::CLOSING, (uint8_t)percent, false});
+}
+
+void MotorControl::requestCalibration()
+{
+    LOG_EVENT("Calibrating window travel...\n");
+    queueCommand({MotorState::CLOSING, MOTOR_TARGET_ENDSTOP, true});
+}
+
+bool MotorControl::isPositionKnown()
+{
+    return positionKnown && travelSteps > 0;
+}
+
+int MotorControl::getPositionPercent()
+{
+    if (!isPositionKnown())
+    {
+        return -1;
+    }
+
+    int32_t percent = (int32_t)((int64_t)StepEngine::getPosition() * 100 / travelSteps);
+    return constrain(percent, 0, 100);
 }
 
 String MotorControl::getWindowStateString(WindowState state)
@@ -379,6 +893,10 @@ String MotorControl::getWindowStateString(WindowState state)
         return String("RESTARTING");
         break;
 
+    case WindowState::PARTIALLY_OPEN:
+        return String("PARTIALLY_OPEN");
+        break;
+
     default:
         return String("UNKNOWN");
         break;
@@ -405,4 +923,68 @@ String MotorControl::getMotorStateString(MotorState state)
         return String("UNKNOWN");
         break;
     }
-}
\ No newline at end of file
+}
+
+uint32_t MotorControl::getMoveLogTotal()
+{
+    return moveLogTotal;
+}
+
+bool MotorControl::getMoveRecord(uint32_t sequence, MoveRecord &record)
+{
+    if (sequence >= moveLogTotal || moveLogTotal - sequence > MOTOR_MOVE_LOG_SIZE)
+    {
+        return false;
+    }
+
+    record = moveLog[sequence % MOTOR_MOVE_LOG_SIZE];
+    return true;
+}
+
+void MotorControl::printMoveLog()
+{
+    uint32_t first = moveLogTotal > MOTOR_MOVE_LOG_SIZE ? moveLogTotal - MOTOR_MOVE_LOG_SIZE : 0;
+
+    LOG.printf("Last %u of %u moves:\n", (unsigned int)(moveLogTotal - first), (unsigned int)moveLogTotal);
+
+    MoveRecord record;
+    for (uint32_t i = first; getMoveRecord(i, record); i++)
+    {
+        LOG.printf("#%u %s %s, %u steps in %lu ms from %lu, step gap max %u us p99 %u us, pass max %u us\n",
+                   (unsigned int)i,
+                   record.closing ? "closing" : "opening",
+                   getMoveEndReasonString(record.reason).c_str(),
+                   (unsigned int)record.steps,
+                   record.endMillis - record.startMillis,
+                   record.startMillis,
+                   (unsigned int)record.maxGapMicros,
+                   (unsigned int)record.p99GapMicros,
+                   (unsigned int)record.maxPassMicros);
+    }
+}
+
+String MotorControl::getMoveEndReasonString(MoveEndReason reason)
+{
+    switch (reason)
+    {
+    case MoveEndReason::ENDSTOP:
+        return String("ENDSTOP");
+        break;
+
+    case MoveEndReason::TARGET:
+        return String("TARGET");
+        break;
+
+    case MoveEndReason::TIMEOUT:
+        return String("TIMEOUT");
+        break;
+
+    case MoveEndReason::STOPPED:
+        return String("STOPPED");
+        break;
+
+    default:
+        return String("UNKNOWN");
+        break;
+    }
+}
@@ -2,24 +2,80 @@
 #include "shared.h"
 #include "led_control.h"
 #include "temperature_control.h"
+#include "temperature_history.h"
+#include "thermostat.h"
 #include "motor_control.h"
+#include "loop_profiler.h"
+#include "mqtt_dispatch.h"
+#include "mqtt_outbox.h"
+#include "binary_log.h"
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#include <atomic>
+
+// Steps of a connection attempt, one step runs per handle()
+enum class MqttConnectState : uint8_t
+{
+    WAITING = 0,     // Backing off until the next attempt
+    RESOLVING = 1,   // Broker name to address, skipped for an address literal
+    CONNECTING = 2,  // TCP connect
+    HANDSHAKING = 3, // MQTT CONNECT and CONNACK
+    SUBSCRIBING = 4, // One subscription per step
+    CONNECTED = 5
+};
 
 class MqttControl
 {
 private:
     // Internal static methods
     static void onMessageRecived(char *topic, byte *message, unsigned int length);
-    static void registerSubscriptions();
-    static void connect();
+    static bool subscribeNext(); // True once every subscription is sent
+    static void handleConnection();
+    static void onConnectFailed(const char *step);
+    static bool startResolve(); // False if the lookup could not be started
+    static void resolveInTcpip(void *attempt);
+    static void onBrokerResolved(const char *name, const ip_addr_t *address, void *attempt);
 
     // Handing setup
     static bool needsInit;
-    static unsigned long lastConnectTryTime;
 
-    // Periodic temperature updates
-    static unsigned long lastTempSend;
+    // Connection state machine
+    static MqttConnectState connectState;
+    static unsigned long nextConnectTry;
+    static uint8_t connectFailures; // Attempts failed in a row, sets the backoff
+    static uint8_t subscriptionIndex;
+    static IPAddress brokerAddress;
+    static bool brokerIsAddress; // MQTT_SERVER_IP is an address literal, nothing to resolve
+
+    // Broker lookup, answered by lwIP from the tcpip task
+    static bool resolveStarted;
+    static unsigned long resolveStart;
+    static std::atomic<uint8_t> resolveAttempt; // A late answer to an abandoned lookup is ignored
+    static std::atomic<bool> resolveDone;
+    static std::atomic<uint32_t> resolvedAddress; // 0 if the name did not resolve
+
+    // Temperatures are published when they move past the deadband or get too old
+    static unsigned long lastTempSend[TEMPERATURE_MAX_SENSORS];
+    static TemperatureRaw lastTempSent[TEMPERATURE_MAX_SENSORS];
+    static bool historyRequested;
+
+    // Move telemetry published so far
+    static uint32_t nextMoveToPublish;
+    static char telemetryBuffer[MQTT_BUFFER_SIZE];
 
-    static void onWindowStateChanged(WindowState *curWindowState);
+    static void publishMoveTelemetry();
+
+#if LOOP_PROFILER && LOOP_PROFILER_PUBLISH_INTERVAL > 0
+    static unsigned long lastLoopProfileSend;
+#endif
+
+    // Event bus subscribers
+    static void onWindowStateEvent(const Event &event);
+    static void onTemperatureEvent(const Event &event);
+    static void queueTemperature(uint8_t sensor, TemperatureRaw temperature);
+    static void queueAllTemperatures();
+    static void queueThermostatState();
+    static ThermostatMode thermostatModeSent; // Queued again when the mode changes outside a command
 
 public:
     // Public static methods
@@ -30,109 +86,392 @@ public:
 
 // Static member definitions
 bool MqttControl::needsInit = true;
-unsigned long MqttControl::lastConnectTryTime = 0U;
-unsigned long MqttControl::lastTempSend = 0U;
+MqttConnectState MqttControl::connectState = MqttConnectState::WAITING;
+unsigned long MqttControl::nextConnectTry = 0U;
+uint8_t MqttControl::connectFailures = 0;
+uint8_t MqttControl::subscriptionIndex = 0;
+IPAddress MqttControl::brokerAddress;
+ThermostatMode MqttControl::thermostatModeSent = ThermostatMode::OFF;
+bool MqttControl::brokerIsAddress = false;
+bool MqttControl::resolveStarted = false;
+unsigned long MqttControl::resolveStart = 0U;
+std::atomic<uint8_t> MqttControl::resolveAttempt(0);
+std::atomic<bool> MqttControl::resolveDone(false);
+std::atomic<uint32_t> MqttControl::resolvedAddress(0U);
+unsigned long MqttControl::lastTempSend[TEMPERATURE_MAX_SENSORS];
+TemperatureRaw MqttControl::lastTempSent[TEMPERATURE_MAX_SENSORS];
+bool MqttControl::historyRequested = false;
+uint32_t MqttControl::nextMoveToPublish = 0U;
+char MqttControl::telemetryBuffer[MQTT_BUFFER_SIZE];
+#if LOOP_PROFILER && LOOP_PROFILER_PUBLISH_INTERVAL > 0
+unsigned long MqttControl::lastLoopProfileSend = 0U;
+#endif
 
 // Private methods
 void MqttControl::onMessageRecived(char *topic, byte *message, unsigned int length)
 {
-    String response;
-
-    String _topic = String(topic);
+    // Parsed in place, nothing here allocates
+    MqttMessage parsed;
+    MqttDispatch::parse(topic, message, length, parsed);
 
-    for (int i = 0; i < length; i++)
-    {
-        response += (char)message[i];
-    }
-
-    LOG.print("Message arrived [");
-    LOG.print(topic);
-    LOG.print("] ");
-    LOG.println(response);
+    LOG_EVENT("Message arrived [%s] %s\n", topic, parsed.payload);
 
-    if (_topic.equals(COMMAND_TOPIC))
+    if (parsed.topic == MqttTopic::COMMAND)
     {
-        // The response is a command
-
-        if (response == "OPEN")
+#ifdef ENABLE_TEMP_FEATURE
+        // Window commands from the server take over from the thermostat
+        if (parsed.verb == MqttVerb::OPEN || parsed.verb == MqttVerb::CLOSE || parsed.verb == MqttVerb::STOP ||
+            parsed.verb == MqttVerb::OPEN_PERCENT || parsed.verb == MqttVerb::CALIBRATE)
         {
-            MotorControl::setRequestedMotorState(MotorState::OPENING);
+            Thermostat::override();
+            queueThermostatState();
         }
-        else if (response == "CLOSE")
+#endif
+
+        switch (parsed.verb)
         {
+        case MqttVerb::OPEN:
+            MotorControl::setRequestedMotorState(MotorState::OPENING);
+            break;
+
+        case MqttVerb::CLOSE:
             MotorControl::setRequestedMotorState(MotorState::CLOSING);
-        }
-        else if (response == "STOP")
-        {
+            break;
+
+        case MqttVerb::STOP:
             MotorControl::setRequestedMotorState(MotorState::STOPPED);
+            break;
+
+        case MqttVerb::OPEN_PERCENT:
+            // Partial open, e.g. "OPEN 35"
+            MotorControl::setRequestedPosition(parsed.argument);
+            break;
+
+        case MqttVerb::CALIBRATE:
+            MotorControl::requestCalibration();
+            break;
+
+        case MqttVerb::RESTART:
+            Utilities::restartController();
+            break;
+
+        default:
+            // Do nothing
+            break;
         }
-        else if (response == "RESTART")
+    }
+    else if (parsed.topic == MqttTopic::TEMP_REQUEST)
+    {
+        if (parsed.verb == MqttVerb::TEMP)
         {
-            Utilities::restartController();
+            queueAllTemperatures();
         }
-        else
+        else if (parsed.verb == MqttVerb::HISTORY)
         {
-            // Do nothing
+            historyRequested = true;
         }
     }
-    else if (_topic.equals(TEMP_REQUEST_TOPIC))
+#ifdef ENABLE_TEMP_FEATURE
+    else if (parsed.topic == MqttTopic::THERMOSTAT)
     {
-        if (response == "TEMP")
+        // The logged payload is cut short, SET needs the whole message
+        char command[THERMOSTAT_COMMAND_SIZE];
+        if (length >= sizeof(command))
         {
-            mqttClient.publish(TEMP_TOPIC.c_str(), String(TemparatureControl::getCurrentTempF()).c_str());
+            LOG_EVENT("Thermostat command of %u bytes is too long.\n", length);
+            return;
         }
+        memcpy(command, message, length);
+        command[length] = '\0';
+
+        Thermostat::handleCommand(command);
+        queueThermostatState();
     }
+#endif
     else
     {
         // Invalid topic
     }
 }
 
-void MqttControl::registerSubscriptions()
+bool MqttControl::subscribeNext()
 {
-    mqttClient.subscribe(COMMAND_TOPIC.c_str());
-    mqttClient.subscribe(UPDATE_TOPIC.c_str());
-    #ifdef ENABLE_TEMP_FEATURE
-    mqttClient.subscribe(TEMP_REQUEST_TOPIC.c_str());
-    #endif
-}
+    switch (subscriptionIndex++)
+    {
+    case 0:
+        mqttClient.subscribe(COMMAND_TOPIC.c_str());
+        return false;
 
-void MqttControl::connect()
-{
-    LOG.println("Connecting to MQTT Server...");
+    case 1:
+        mqttClient.subscribe(UPDATE_TOPIC.c_str());
+        return false;
 
-    LedControl::setStatusLedColor(StatusColors::MQTT_CONNNECTING, false);
+#ifdef ENABLE_TEMP_FEATURE
+    case 2:
+        mqttClient.subscribe(TEMP_REQUEST_TOPIC.c_str());
+        return false;
 
-    needsInit = true;
+    case 3:
+        mqttClient.subscribe(THERMOSTAT_TOPIC.c_str());
+        return false;
+#endif
 
-    while (!mqttClient.connected())
+    default:
+        return true;
+    }
+}
+
+void MqttControl::handleConnection()
+{
+    // Each step is bounded: TCP by MQTT_TCP_CONNECT_TIMEOUT and the CONNACK
+    // wait by MQTT_SOCKET_TIMEOUT, DNS is polled and the rest does not wait at all
+    switch (connectState)
     {
-        LOG.println("Attempting MQTT connection...");
+    case MqttConnectState::WAITING:
+        if ((long)(millis() - nextConnectTry) >= 0)
+        {
+            LOG_EVENT("Connecting to MQTT Server...\n");
+            EventBus::publish(Event::connectivityChanged(Connectivity::MQTT_CONNECTING));
+            needsInit = true;
+            connectState = brokerIsAddress ? MqttConnectState::CONNECTING : MqttConnectState::RESOLVING;
+        }
+        break;
 
-        if (mqttClient.connect(CLIENT_ID, CLIENT_ID, MQTT_SERVER_PASSWORD))
+    case MqttConnectState::RESOLVING:
+        if (!resolveStarted && !startResolve())
+        {
+            onConnectFailed("resolve");
+        }
+        else if (resolveDone)
         {
-            registerSubscriptions();
-            LOG.print("Connected to ");
-            LOG.print(MQTT_SERVER_IP);
-            LOG.println(".");
-            LedControl::setBaseStatus();
+            resolveStarted = false;
+            if (resolvedAddress == 0)
+            {
+                onConnectFailed("resolve");
+                break;
+            }
+            brokerAddress = IPAddress(resolvedAddress);
+            mqttClient.setServer(brokerAddress, MQTT_SERVER_PORT);
+            connectState = MqttConnectState::CONNECTING;
         }
-        else
+        else if (millis() - resolveStart >= MQTT_DNS_TIMEOUT)
         {
-            LOG.println("Failed to connect to MQTT Server.");
-            LedControl::setBaseStatus();
+            resolveStarted = false;
+            onConnectFailed("resolve");
+        }
+        break;
+
+    case MqttConnectState::CONNECTING:
+        if (!wifiClient.connect(brokerAddress, MQTT_SERVER_PORT, MQTT_TCP_CONNECT_TIMEOUT))
+        {
+            onConnectFailed("TCP connect");
             break;
         }
+        connectState = MqttConnectState::HANDSHAKING;
+        break;
+
+    case MqttConnectState::HANDSHAKING:
+        // The TCP connection is already open, so this only sends CONNECT and waits for CONNACK
+        if (!mqttClient.connect(CLIENT_ID, CLIENT_ID, MQTT_SERVER_PASSWORD))
+        {
+            onConnectFailed("CONNACK");
+            break;
+        }
+        subscriptionIndex = 0;
+        connectState = MqttConnectState::SUBSCRIBING;
+        break;
+
+    case MqttConnectState::SUBSCRIBING:
+        if (!mqttClient.connected())
+        {
+            onConnectFailed("subscribe");
+        }
+        else if (subscribeNext())
+        {
+            LOG_EVENT("Connected to %s.\n", MQTT_SERVER_IP);
+            connectFailures = 0;
+            connectState = MqttConnectState::CONNECTED;
+            EventBus::publish(Event::connectivityChanged(Connectivity::MQTT_CONNECTED));
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void MqttControl::onConnectFailed(const char *step)
+{
+    wifiClient.stop();
+
+    // Exponential backoff with jitter, so a fleet does not reconnect in lockstep after a broker restart
+    uint8_t doublings = connectFailures < 16 ? connectFailures : 16;
+    unsigned long backoff = min((unsigned long)MQTT_BACKOFF_MAX, (unsigned long)MQTT_BACKOFF_MIN << doublings);
+    backoff = backoff / 2 + random(backoff / 2 + 1);
+    if (connectFailures < 255)
+    {
+        connectFailures++;
+    }
+
+    LOG_EVENT("Failed to connect to MQTT Server at %s, retrying in %lu ms.\n", step, backoff);
+    nextConnectTry = millis() + backoff;
+    connectState = MqttConnectState::WAITING;
+    EventBus::publish(Event::connectivityChanged(Connectivity::MQTT_DISCONNECTED));
+}
+
+bool MqttControl::startResolve()
+{
+    resolveDone = false;
+    resolvedAddress = 0;
+    resolveAttempt++;
+
+    // lwIP's raw DNS API may only be called from the tcpip task
+    if (tcpip_callback(resolveInTcpip, (void *)(uintptr_t)resolveAttempt.load()) != ERR_OK)
+    {
+        return false;
     }
+
+    resolveStart = millis();
+    resolveStarted = true;
+    return true;
+}
+
+void MqttControl::resolveInTcpip(void *attempt)
+{
+    ip_addr_t address;
+    err_t result = dns_gethostbyname(MQTT_SERVER_IP, &address, onBrokerResolved, attempt);
+    if (result == ERR_OK)
+    {
+        // Answered from the lwIP cache, the callback is not called
+        onBrokerResolved(MQTT_SERVER_IP, &address, attempt);
+    }
+    else if (result != ERR_INPROGRESS)
+    {
+        onBrokerResolved(MQTT_SERVER_IP, NULL, attempt);
+    }
+}
+
+void MqttControl::onBrokerResolved(const char *name, const ip_addr_t *address, void *attempt)
+{
+    // Runs in the tcpip task, only hands the answer over
+    if ((uint8_t)(uintptr_t)attempt != resolveAttempt)
+    {
+        return;
+    }
+
+    resolvedAddress = address != NULL ? address->u_addr.ip4.addr : 0;
+    resolveDone = true;
+}
+
+void MqttControl::onWindowStateEvent(const Event &event)
+{
+    // Queued even while offline or moving, the outbox sends the latest once it can
+    notifyStateUpdate(MotorControl::getWindowStateString(event.windowState));
+
+    if (!MotorControl::isMotorMoving() && MotorControl::isPositionKnown())
+    {
+        char position[8];
+        snprintf(position, sizeof(position), "%d", MotorControl::getPositionPercent());
+        MqttOutbox::put(POSITION_TOPIC, position);
+    }
+}
+
+void MqttControl::onTemperatureEvent(const Event &event)
+{
+    if (event.sensor >= TEMPERATURE_MAX_SENSORS)
+    {
+        return;
+    }
+
+    // Readings arrive more often than they change
+    if (abs(event.temperature - lastTempSent[event.sensor]) >= MQTT_TEMP_DEADBAND || millis() - lastTempSend[event.sensor] >= MQTT_TEMP_MAX_AGE)
+    {
+        queueTemperature(event.sensor, event.temperature);
+    }
+}
+
+void MqttControl::queueTemperature(uint8_t sensor, TemperatureRaw temperature)
+{
+#if MQTT_TEMP_PAYLOAD_RAW
+    // Little endian int16 in 1/16 C
+    uint8_t payload[2] = {(uint8_t)(temperature & 0xFF), (uint8_t)((uint16_t)temperature >> 8)};
+    MqttOutbox::put(TEMP_SENSOR_TOPICS[sensor], payload, sizeof(payload));
+#else
+    char payload[12];
+    TemperatureFormat::formatF(temperature, 2, payload, sizeof(payload));
+    MqttOutbox::put(TEMP_SENSOR_TOPICS[sensor], payload);
+#endif
+    lastTempSend[sensor] = millis();
+    lastTempSent[sensor] = temperature;
+}
+
+void MqttControl::queueAllTemperatures()
+{
+#ifdef ENABLE_TEMP_FEATURE
+    for (uint8_t i = 0; i < TemparatureControl::getSensorCount(); i++)
+    {
+        queueTemperature(i, TemparatureControl::getCurrentTemp(i));
+    }
+#endif
+}
+
+void MqttControl::queueThermostatState()
+{
+#ifdef ENABLE_TEMP_FEATURE
+    thermostatModeSent = Thermostat::getMode();
+    MqttOutbox::put(THERMOSTAT_STATE_TOPIC, Thermostat::getModeString(thermostatModeSent));
+#endif
 }
 
-void MqttControl::onWindowStateChanged(WindowState *curWindowState)
+void MqttControl::publishMoveTelemetry()
 {
-    WindowState newState = *curWindowState;
+    uint32_t total = MotorControl::getMoveLogTotal();
+    if (nextMoveToPublish >= total)
+    {
+        return;
+    }
+
+    // Moves that already fell out of the ring buffer are skipped
+    if (total - nextMoveToPublish > MOTOR_MOVE_LOG_SIZE)
+    {
+        nextMoveToPublish = total - MOTOR_MOVE_LOG_SIZE;
+    }
+
+    // One JSON array per message, at most MQTT_TELEMETRY_BATCH moves
+    size_t length = snprintf(telemetryBuffer, sizeof(telemetryBuffer), "[");
+    uint32_t sequence = nextMoveToPublish;
+    MoveRecord record;
+
+    while (sequence - nextMoveToPublish < MQTT_TELEMETRY_BATCH && MotorControl::getMoveRecord(sequence, record))
+    {
+        int written = snprintf(telemetryBuffer + length, sizeof(telemetryBuffer) - length,
+                               "%s{\"seq\":%u,\"dir\":\"%s\",\"reason\":\"%s\",\"start\":%lu,\"end\":%lu,\"steps\":%u,\"maxGapUs\":%u,\"p99GapUs\":%u,\"maxPassUs\":%u}",
+                               sequence == nextMoveToPublish ? "" : ",",
+                               (unsigned int)sequence,
+                               record.closing ? "CLOSING" : "OPENING",
+                               MotorControl::getMoveEndReasonString(record.reason).c_str(),
+                               record.startMillis,
+                               record.endMillis,
+                               (unsigned int)record.steps,
+                               (unsigned int)record.maxGapMicros,
+                               (unsigned int)record.p99GapMicros,
+                               (unsigned int)record.maxPassMicros);
+
+        if (written < 0 || length + written + 2 > sizeof(telemetryBuffer))
+        {
+            // Out of room, the rest goes in the next message
+            break;
+        }
+
+        length += written;
+        sequence++;
+    }
+
+    snprintf(telemetryBuffer + length, sizeof(telemetryBuffer) - length, "]");
 
-    if (mqttClient.connected())
+    if (mqttClient.publish(TELEMETRY_TOPIC.c_str(), telemetryBuffer))
     {
-        notifyStateUpdate(MotorControl::getWindowStateString(newState));
+        nextMoveToPublish = sequence;
     }
 }
 
@@ -141,28 +480,58 @@ void MqttControl::begin()
 {
     LOG.println("Setting up MQTT...");
 
-    MotorControl::setWindowStateChangeCallback(onWindowStateChanged);
+    EventBus::subscribe(EventType::WINDOW_STATE, onWindowStateEvent);
+#ifdef ENABLE_TEMP_FEATURE
+    EventBus::subscribe(EventType::TEMPERATURE, onTemperatureEvent);
+    TEMP_SENSOR_TOPICS[0] = TEMP_TOPIC;
+    for (uint8_t i = 1; i < TEMPERATURE_MAX_SENSORS; i++)
+    {
+        TEMP_SENSOR_TOPICS[i] = TEMP_TOPIC + "/" + String(i);
+    }
+#endif
 
     needsInit = true;
 
-    mqttClient.setServer(MQTT_SERVER_IP, MQTT_SERVER_PORT);
+    // An address literal is used as is, a name is looked up on every connection attempt
+    brokerIsAddress = brokerAddress.fromString(MQTT_SERVER_IP);
+    if (brokerIsAddress)
+    {
+        mqttClient.setServer(brokerAddress, MQTT_SERVER_PORT);
+    }
+    MqttDispatch::addTopic(COMMAND_TOPIC.c_str(), MqttTopic::COMMAND);
+    MqttDispatch::addTopic(TEMP_REQUEST_TOPIC.c_str(), MqttTopic::TEMP_REQUEST);
+    MqttDispatch::addTopic(THERMOSTAT_TOPIC.c_str(), MqttTopic::THERMOSTAT);
     mqttClient.setCallback(onMessageRecived);
+    mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
+    mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
 
-    connect();
+    // The first attempt starts on the first handle()
+    connectState = MqttConnectState::WAITING;
+    nextConnectTry = millis();
 }
 
 void MqttControl::handle()
 {
-    if (!mqttClient.connected())
+#ifdef ENABLE_TEMP_FEATURE
+    // An override running out or one from the remote
+    if (Thermostat::getMode() != thermostatModeSent)
+    {
+        queueThermostatState();
+    }
+#endif
+
+    if (connectState == MqttConnectState::CONNECTED && !mqttClient.connected())
+    {
+        LOG_EVENT("Lost the connection to the MQTT Server.\n");
+        onConnectFailed("connection lost");
+    }
+
+    if (connectState != MqttConnectState::CONNECTED)
     {
         if (!MotorControl::isMotorMoving())
         {
             // Only run if motor is not moving..
-            if (millis() - lastConnectTryTime >= MQTT_CONNECT_TRY_INTERVAL)
-            {
-                connect();
-                lastConnectTryTime = millis();
-            }
+            handleConnection();
         }
     }
     else
@@ -171,25 +540,43 @@ void MqttControl::handle()
         if (!MotorControl::isMotorMoving())
         {
 // Only run if motor is not moving..
+            // Send info about controller to server
+            if (needsInit && !MotorControl::isMotorMoving())
+            {
+                notifyStateUpdate(MotorControl::getWindowStateString(MotorControl::getCurrentWindowState()));
+                queueAllTemperatures();
+                queueThermostatState();
+                MqttOutbox::put(FIRMWARE_VERSION_TOPIC, String(FIRMWARE_VERSION));
+                needsInit = false;
+            }
+
+            MqttOutbox::flush();
+            publishMoveTelemetry();
+
 #ifdef ENABLE_TEMP_FEATURE
-            // Periodic temp sending
-            if (millis() - lastTempSend >= MQTT_TEMP_INTERVAL && !MotorControl::isMotorMoving())
+            if (historyRequested)
             {
-                mqttClient.publish(TEMP_TOPIC.c_str(), String(TemparatureControl::getCurrentTempF()).c_str());
-                lastTempSend = millis();
+                if (TemperatureHistory::formatJson(telemetryBuffer, sizeof(telemetryBuffer), TemparatureControl::getSensorCount()) > 0)
+                {
+                    mqttClient.publish(TEMP_HISTORY_TOPIC.c_str(), telemetryBuffer);
+                }
+                else
+                {
+                    LOG_EVENT("Temperature history does not fit in MQTT_BUFFER_SIZE.\n");
+                }
+                historyRequested = false;
             }
 #endif
 
-            // Send info about controller to server
-            if (needsInit && !MotorControl::isMotorMoving())
+#if LOOP_PROFILER && LOOP_PROFILER_PUBLISH_INTERVAL > 0
+            // The published profile covers the time since the last one
+            if (millis() - lastLoopProfileSend >= LOOP_PROFILER_PUBLISH_INTERVAL && LoopProfiler::formatJson(telemetryBuffer, sizeof(telemetryBuffer)) > 0)
             {
-                mqttClient.publish(STATE_TOPIC.c_str(), MotorControl::getWindowStateString(MotorControl::getCurrentWindowState()).c_str());
-                #ifdef ENABLE_TEMP_FEATURE
-                mqttClient.publish(TEMP_TOPIC.c_str(), String(TemparatureControl::getCurrentTempF()).c_str());
-                #endif
-                mqttClient.publish(FIRMWARE_VERSION_TOPIC.c_str(), String(FIRMWARE_VERSION).c_str());
-                needsInit = false;
+                mqttClient.publish(LOOP_PROFILE_TOPIC.c_str(), telemetryBuffer);
+                LoopProfiler::reset();
+                lastLoopProfileSend = millis();
             }
+#endif
         }
     }
 
@@ -198,5 +585,5 @@ void MqttControl::handle()
 
 void MqttControl::notifyStateUpdate(String newState)
 {
-    mqttClient.publish(STATE_TOPIC.c_str(), newState.c_str());
+    MqttOutbox::put(STATE_TOPIC, newState);
 }
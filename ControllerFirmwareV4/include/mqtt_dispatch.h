@@ -0,0 +1,153 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// Only needs the C library and the settings from shared.h, which lets
+// tools/mqtt_dispatch_bench.cpp build it on the host.
+
+enum class MqttTopic : uint8_t
+{
+    UNKNOWN = 0,
+    COMMAND = 1,
+    TEMP_REQUEST = 2,
+    THERMOSTAT = 3
+};
+
+enum class MqttVerb : uint8_t
+{
+    UNKNOWN = 0,
+    OPEN = 1,
+    OPEN_PERCENT = 2, // "OPEN 35"
+    CLOSE = 3,
+    STOP = 4,
+    CALIBRATE = 5,
+    RESTART = 6,
+    TEMP = 7,
+    HISTORY = 8
+};
+
+struct MqttMessage
+{
+    MqttTopic topic;
+    MqttVerb verb;
+    int argument;
+    char payload[MQTT_DISPATCH_MAX_PAYLOAD + 1]; // Null terminated copy for logging, cut to fit
+};
+
+// Turns a raw PubSubClient message into a topic and a verb without touching
+// the heap. Topics are registered once with their hash, a message costs one
+// hash of the topic and a few short compares of the payload.
+class MqttDispatch
+{
+private:
+    struct TopicEntry
+    {
+        uint32_t hash;
+        const char *name;
+        MqttTopic topic;
+    };
+
+    struct VerbEntry
+    {
+        const char *name;
+        uint8_t length;
+        MqttVerb verb;
+    };
+
+    static TopicEntry topics[MQTT_DISPATCH_MAX_TOPICS];
+    static uint8_t topicCount;
+    static const VerbEntry verbs[];
+
+    static uint32_t hash(const char *text)
+    {
+        // FNV-1a
+        uint32_t value = 2166136261UL;
+        while (*text != '\0')
+        {
+            value = (value ^ (uint8_t)*text++) * 16777619UL;
+        }
+        return value;
+    }
+
+    static MqttVerb parseVerb(const uint8_t *payload, unsigned int length, int &argument)
+    {
+        for (uint8_t i = 0; verbs[i].name != NULL; i++)
+        {
+            if (length == verbs[i].length && memcmp(payload, verbs[i].name, length) == 0)
+            {
+                return verbs[i].verb;
+            }
+        }
+
+        // "OPEN <percent>"
+        if (length > 5 && memcmp(payload, "OPEN ", 5) == 0)
+        {
+            int value = 0;
+            for (unsigned int i = 5; i < length; i++)
+            {
+                if (payload[i] < '0' || payload[i] > '9' || value > 1000)
+                {
+                    return MqttVerb::UNKNOWN;
+                }
+                value = value * 10 + (payload[i] - '0');
+            }
+
+            argument = value;
+            return MqttVerb::OPEN_PERCENT;
+        }
+
+        return MqttVerb::UNKNOWN;
+    }
+
+public:
+    // The name must stay valid, e.g. a global topic String
+    static bool addTopic(const char *name, MqttTopic topic)
+    {
+        if (topicCount >= MQTT_DISPATCH_MAX_TOPICS)
+        {
+            return false;
+        }
+
+        topics[topicCount++] = {hash(name), name, topic};
+        return true;
+    }
+
+    static MqttTopic matchTopic(const char *name)
+    {
+        uint32_t value = hash(name);
+        for (uint8_t i = 0; i < topicCount; i++)
+        {
+            // The compare only runs on a hash match
+            if (topics[i].hash == value && strcmp(topics[i].name, name) == 0)
+            {
+                return topics[i].topic;
+            }
+        }
+
+        return MqttTopic::UNKNOWN;
+    }
+
+    static void parse(const char *topic, const uint8_t *payload, unsigned int length, MqttMessage &message)
+    {
+        unsigned int copied = length < MQTT_DISPATCH_MAX_PAYLOAD ? length : MQTT_DISPATCH_MAX_PAYLOAD;
+        memcpy(message.payload, payload, copied);
+        message.payload[copied] = '\0';
+
+        message.topic = matchTopic(topic);
+        message.argument = 0;
+        message.verb = message.topic == MqttTopic::UNKNOWN ? MqttVerb::UNKNOWN : parseVerb(payload, length, message.argument);
+    }
+};
+
+// Static member definitions
+MqttDispatch::TopicEntry MqttDispatch::topics[MQTT_DISPATCH_MAX_TOPICS];
+uint8_t MqttDispatch::topicCount = 0;
+const MqttDispatch::VerbEntry MqttDispatch::verbs[] = {
+    {"OPEN", 4, MqttVerb::OPEN},
+    {"CLOSE", 5, MqttVerb::CLOSE},
+    {"STOP", 4, MqttVerb::STOP},
+    {"CALIBRATE", 9, MqttVerb::CALIBRATE},
+    {"RESTART", 7, MqttVerb::RESTART},
+    {"TEMP", 4, MqttVerb::TEMP},
+    {"HISTORY", 7, MqttVerb::HISTORY},
+    {NULL, 0, MqttVerb::UNKNOWN}};
@@ -0,0 +1,154 @@
+#pragma once
+#include "shared.h"
+
+// Outbound MQTT messages waiting for the link to be up and the motor to be
+// idle. There is one slot per topic, a newer value replaces the pending one,
+// so the server always ends up with the latest value without every
+// intermediate one being sent. Latency is measured from when a topic first
+// became pending to when it was published.
+class MqttOutbox
+{
+private:
+    struct Slot
+    {
+        const char *topic; // Points at a global topic String, NULL if the slot is free
+        uint8_t value[MQTT_OUTBOX_VALUE_SIZE];
+        uint8_t length;
+        unsigned long queuedAt;
+    };
+
+    static Slot slots[MQTT_OUTBOX_SIZE];
+
+    // Counters since boot
+    static uint32_t publishedCount;
+    static uint32_t coalescedCount;
+    static uint32_t droppedCount;
+    static uint32_t maxLatency;
+    static uint64_t totalLatency;
+
+public:
+    static bool put(const String &topic, const uint8_t *value, uint8_t length); // Binary payloads, cut to MQTT_OUTBOX_VALUE_SIZE
+    static bool put(const String &topic, const char *value);
+    static bool put(const String &topic, const String &value);
+    static void flush(uint8_t maxMessages = MQTT_OUTBOX_BATCH);
+    static uint8_t getPendingCount();
+    static void printStats();
+};
+
+// Static member definitions
+MqttOutbox::Slot MqttOutbox::slots[MQTT_OUTBOX_SIZE];
+uint32_t MqttOutbox::publishedCount = 0U;
+uint32_t MqttOutbox::coalescedCount = 0U;
+uint32_t MqttOutbox::droppedCount = 0U;
+uint32_t MqttOutbox::maxLatency = 0U;
+uint64_t MqttOutbox::totalLatency = 0U;
+
+// Public methods
+bool MqttOutbox::put(const String &topic, const uint8_t *value, uint8_t length)
+{
+    Slot *freeSlot = NULL;
+
+    if (length > MQTT_OUTBOX_VALUE_SIZE)
+    {
+        length = MQTT_OUTBOX_VALUE_SIZE;
+    }
+
+    for (uint8_t i = 0; i < MQTT_OUTBOX_SIZE; i++)
+    {
+        if (slots[i].topic != NULL && strcmp(slots[i].topic, topic.c_str()) == 0)
+        {
+            // Still pending, only the newest value is sent
+            memcpy(slots[i].value, value, length);
+            slots[i].length = length;
+            coalescedCount++;
+            return true;
+        }
+
+        if (slots[i].topic == NULL && freeSlot == NULL)
+        {
+            freeSlot = &slots[i];
+        }
+    }
+
+    if (freeSlot == NULL)
+    {
+        droppedCount++;
+        return false;
+    }
+
+    freeSlot->topic = topic.c_str();
+    memcpy(freeSlot->value, value, length);
+    freeSlot->length = length;
+    freeSlot->queuedAt = millis();
+    return true;
+}
+
+bool MqttOutbox::put(const String &topic, const char *value)
+{
+    size_t length = strlen(value);
+    return put(topic, (const uint8_t *)value, length > MQTT_OUTBOX_VALUE_SIZE ? MQTT_OUTBOX_VALUE_SIZE : length);
+}
+
+bool MqttOutbox::put(const String &topic, const String &value)
+{
+    return put(topic, value.c_str());
+}
+
+void MqttOutbox::flush(uint8_t maxMessages)
+{
+    uint8_t sent = 0;
+
+    while (sent < maxMessages)
+    {
+        // Oldest first
+        Slot *oldest = NULL;
+        for (uint8_t i = 0; i < MQTT_OUTBOX_SIZE; i++)
+        {
+            if (slots[i].topic != NULL && (oldest == NULL || (long)(slots[i].queuedAt - oldest->queuedAt) < 0))
+            {
+                oldest = &slots[i];
+            }
+        }
+
+        if (oldest == NULL || !mqttClient.publish(oldest->topic, oldest->value, oldest->length))
+        {
+            // Empty, or the link went down, what is left stays pending
+            return;
+        }
+
+        uint32_t latency = millis() - oldest->queuedAt;
+        totalLatency += latency;
+        if (latency > maxLatency)
+        {
+            maxLatency = latency;
+        }
+
+        oldest->topic = NULL;
+        publishedCount++;
+        sent++;
+    }
+}
+
+uint8_t MqttOutbox::getPendingCount()
+{
+    uint8_t pending = 0;
+    for (uint8_t i = 0; i < MQTT_OUTBOX_SIZE; i++)
+    {
+        if (slots[i].topic != NULL)
+        {
+            pending++;
+        }
+    }
+    return pending;
+}
+
+void MqttOutbox::printStats()
+{
+    LOG.printf("MQTT outbox: %u pending, %u published, %u coalesced, %u dropped, latency mean %u ms max %u ms\n",
+               (unsigned int)getPendingCount(),
+               (unsigned int)publishedCount,
+               (unsigned int)coalescedCount,
+               (unsigned int)droppedCount,
+               (unsigned int)(publishedCount > 0 ? totalLatency / publishedCount : 0),
+               (unsigned int)maxLatency);
+}
@@ -2,6 +2,7 @@
 #include "shared.h"
 #include "motor_control.h"
 #include "led_control.h"
+#include "mqtt_outbox.h"
 
 class OtaHandler
 {
@@ -37,6 +38,9 @@ void OtaHandler::begin()
         .onEnd([]() {
             LedControl::setStatusLedColor(StatusColors::UPDATE_SUCCESS);
             MotorControl::setCurrentWindowState(WindowState::UPDATE_COMPLETE);
+            // The controller restarts before the next loop pass
+            EventBus::dispatch();
+            MqttOutbox::flush(MQTT_OUTBOX_SIZE);
             Serial.println("\nEnd");
         })
         .onProgress([](unsigned int progress, unsigned int total) {
@@ -64,8 +68,7 @@ void OtaHandler::begin()
             {
                 Serial.println("End Failed");
             }
-            LedControl::setErrorHasOccured(true, ErrorCode::UPDATE_ERROR);
-            LedControl::setBaseStatus();
+            EventBus::publish(Event::errorOccured(ErrorCode::UPDATE_ERROR));
         });
 
     ArduinoOTA.begin();
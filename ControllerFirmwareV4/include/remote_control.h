@@ -1,6 +1,9 @@
 #pragma once
 #include "shared.h"
 #include "motor_control.h"
+#ifdef ENABLE_TEMP_FEATURE
+#include "thermostat.h"
+#endif
 
 class RemoteControl
 {
@@ -37,6 +40,9 @@ void RemoteControl::handle()
     {
         if (!isClosing)
         {
+#ifdef ENABLE_TEMP_FEATURE
+            Thermostat::override();
+#endif
             MotorControl::setRequestedMotorState(MotorState::OPENING);
             isOpening = true;
         }
@@ -56,6 +62,9 @@ void RemoteControl::handle()
     {
         if (!isOpening)
         {
+#ifdef ENABLE_TEMP_FEATURE
+            Thermostat::override();
+#endif
             MotorControl::setRequestedMotorState(MotorState::CLOSING);
             isClosing = true;
         }
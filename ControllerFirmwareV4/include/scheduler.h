@@ -0,0 +1,103 @@
+#pragma once
+#include "shared.h"
+#include "loop_profiler.h"
+
+enum class TaskPriority : uint8_t
+{
+    MOTION = 0,    // Runs every pass
+    CONTROL = 1,   // Commands, runs while the motor moves
+    BACKGROUND = 2 // Held back while the motor moves
+};
+
+// Cooperative scheduler for loop(). Each module registers its handle() with a
+// period and a priority. A pass runs the due tasks in priority order and
+// skips everything else, so a module with nothing due costs one compare.
+// BACKGROUND tasks are held back while the motor is moving, which leaves a
+// loop pass during a move with little more than the motor path.
+class Scheduler
+{
+private:
+    struct Task
+    {
+        void (*handle)();
+        unsigned long period;  // ms between runs, 0 runs every pass
+        unsigned long nextRun; // millis() deadline
+        TaskPriority priority;
+        uint8_t profileModule; // LoopModule for the loop profiler
+    };
+
+    static Task tasks[SCHEDULER_MAX_TASKS];
+    static uint8_t taskCount;
+    static bool (*isBusy)(); // BACKGROUND tasks wait while this returns true
+
+    static void runTask(Task &task, unsigned long now);
+
+public:
+    static void setBusyCheck(bool (*busyCheck)());
+    static bool add(void (*handle)(), unsigned long period, TaskPriority priority, uint8_t profileModule);
+    static void run();
+};
+
+// Static member definitions
+Scheduler::Task Scheduler::tasks[SCHEDULER_MAX_TASKS];
+uint8_t Scheduler::taskCount = 0;
+bool (*Scheduler::isBusy)() = NULL;
+
+// Private methods
+void Scheduler::runTask(Task &task, unsigned long now)
+{
+    // Next deadline from the previous one so periods do not drift, unless it fell behind
+    task.nextRun = (now - task.nextRun >= task.period) ? now + task.period : task.nextRun + task.period;
+
+    LOOP_PROFILE((LoopModule)task.profileModule, task.handle());
+}
+
+// Public methods
+void Scheduler::setBusyCheck(bool (*busyCheck)())
+{
+    isBusy = busyCheck;
+}
+
+bool Scheduler::add(void (*handle)(), unsigned long period, TaskPriority priority, uint8_t profileModule)
+{
+    if (taskCount >= SCHEDULER_MAX_TASKS)
+    {
+        LOG.println("Scheduler is full, task not added.");
+        return false;
+    }
+
+    // Keep the table sorted by priority so a pass is a single walk
+    uint8_t index = taskCount;
+    while (index > 0 && tasks[index - 1].priority > priority)
+    {
+        tasks[index] = tasks[index - 1];
+        index--;
+    }
+
+    tasks[index] = {handle, period, millis(), priority, profileModule};
+    taskCount++;
+    return true;
+}
+
+void Scheduler::run()
+{
+    unsigned long now = millis();
+    bool busy = isBusy != NULL && isBusy();
+
+    for (uint8_t i = 0; i < taskCount; i++)
+    {
+        Task &task = tasks[i];
+
+        if (task.priority == TaskPriority::BACKGROUND && busy)
+        {
+            // Sorted by priority, everything from here on is background
+            break;
+        }
+
+        // Wrap safe check for a deadline that has passed
+        if (task.period == 0 || (long)(now - task.nextRun) >= 0)
+        {
+            runTask(task, now);
+        }
+    }
+}
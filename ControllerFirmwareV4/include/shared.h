@@ -25,6 +25,28 @@
 // Settings for temperature_control.h
 #define ONE_WIRE_BUS 14
 #define LOG_TEMPERATURE false
+#define TEMPERATURE_READ_INTERVAL 10000 // ms between readings published on the event bus
+#define TEMPERATURE_RESOLUTION 9 // Bits, 9 bits converts in 94 ms
+#define TEMPERATURE_MAX_SENSORS 3 // Sensors on ONE_WIRE_BUS, e.g. indoor, outdoor and frame
+#define TEMPERATURE_PREFERENCES_NAMESPACE "temperature" // ROM address of the sensor in each role
+
+// Settings for temperature_history.h
+#define TEMPERATURE_HISTORY_FINE_SIZE 30          // Last readings kept as read, 5 minutes
+#define TEMPERATURE_HISTORY_BUCKET_PERIOD 900000  // ms rolled up into one min/avg/max bucket
+#define TEMPERATURE_HISTORY_BUCKETS 24            // 6 hours of buckets
+
+// Settings for thermostat.h, the defaults can be changed over MQTT and are kept in NVS
+#define THERMOSTAT_SENSOR 0 // Sensor the thermostat follows, the indoor one
+#define THERMOSTAT_PREFERENCES_NAMESPACE "thermostat"
+#define THERMOSTAT_DEFAULT_OPEN_F 78.0f
+#define THERMOSTAT_DEFAULT_CLOSE_F 74.0f
+#define THERMOSTAT_DEFAULT_FULL_OPEN true      // false leaves the fully open level off
+#define THERMOSTAT_DEFAULT_FULL_OPEN_F 84.0f
+#define THERMOSTAT_DEFAULT_PARTIAL_PERCENT 30
+#define THERMOSTAT_DEFAULT_DWELL 600000        // ms between thermostat moves
+#define THERMOSTAT_OVERRIDE_TIME 7200000       // ms a manual command pauses the thermostat, 0 until RESUME
+#define THERMOSTAT_COMMAND_SIZE 64             // Longest THERMOSTAT message, longer ones are rejected
+#define THERMOSTAT_MAX_DWELL 86400             // s, longest dwell time SET accepts
 
 // Settings for motor_control.h
 #define STEP_PIN 16
@@ -40,6 +62,69 @@
 #define MOTOR_SPEED 9500
 #define AUTO_CLOSE_ON_STARTUP false
 #define MOTOR_RUN_TIMEOUT 15000 // Motor should not run for more than 15 seconds
+#define MOTOR_COMMAND_QUEUE_SIZE 8 // Must be a power of two
+#define MOTION_TASK_CORE 1
+#define MOTION_TASK_PRIORITY 2 // Above the Arduino loop task
+#define MOTION_TASK_POLLED_PRIORITY 1 // Same as the Arduino loop task, the polled backend takes turns with it
+#define MOTION_TASK_STACK_SIZE 4096
+#define MOTION_TASK_IDLE_WAIT 100 // Wake up at least every 100 ms while idle
+#define MOTION_PASS_BUDGET_US 50  // Motion task pass length during a move past which command handling waits a pass
+#define MOTOR_TARGET_ENDSTOP 255 // Target percentage for moves that run into an endstop
+#define MOTOR_ENDSTOP_APPROACH 800 // Fine steps short of an expected endstop where the move ramps down and creeps on
+#define MOTOR_PREFERENCES_NAMESPACE "motor"
+#define MOTOR_MOVE_LOG_SIZE 16  // Moves kept for telemetry
+#define MOTOR_MOVE_QUEUE_SIZE 4 // Must be a power of two
+
+// Settings for motion_planner.h
+#define MOTION_PLANNER_REVERSAL_DWELL 150 // Pause in ms between ramping down and moving the other way
+
+// Settings for endstop_control.h
+#ifndef ENDSTOP_GLITCH_FILTER_US
+#define ENDSTOP_GLITCH_FILTER_US 200 // Endstop level must be stable this long, 0 disables the filter
+#endif
+#define ENDSTOP_OPEN_TIMER_NUM 1
+#define ENDSTOP_CLOSED_TIMER_NUM 2
+
+// Settings for travel_model.h
+#define TRAVEL_MODEL_PREFERENCES_NAMESPACE "travel_model"
+#define TRAVEL_MODEL_MIN_SAMPLES 3   // Full moves needed before the learned limits are used
+#define TRAVEL_MODEL_MAX_SAMPLES 50  // Older moves fade out after this many
+#define TRAVEL_MODEL_DEVIATIONS 4.0f // Standard deviations allowed above the mean
+#define TRAVEL_MODEL_TIME_MARGIN 500 // Extra milliseconds on top of the learned envelope
+#define TRAVEL_MODEL_STEP_MARGIN 400 // Extra steps on top of the learned envelope
+#define TRAVEL_MODEL_FULL_MOVE 0     // Expected steps for a move of unknown length
+
+// Settings for step_engine.h
+#define STEP_BACKEND_POLLED 0 // AccelStepper::runSpeed() from loop()
+#define STEP_BACKEND_TIMER 1  // Hardware timer ISR
+#define STEP_BACKEND_RMT 2    // RMT peripheral, refilled in batches
+#ifndef STEP_BACKEND
+#define STEP_BACKEND STEP_BACKEND_TIMER
+#endif
+#define STEP_TIMER_NUM 0
+#define STEP_TIMER_DIVIDER 80 // 80MHz APB clock / 80 = 1us timer ticks
+#define STEP_TIMER_TICKS_PER_SECOND 1000000.0f
+#define STEP_RMT_CHANNEL RMT_CHANNEL_0
+#define STEP_RMT_BATCH_SIZE 63 // Steps per refill, one 64 item RMT memory block minus the end marker
+#ifndef ADAPTIVE_MICROSTEPPING
+#define ADAPTIVE_MICROSTEPPING 1 // Switch to coarse steps at speed, 0 keeps fine steps for the whole move
+#endif
+#define MICROSTEP_FINE_PINS 0b011   // MICRO_PIN_1..3 levels, bit 0 is MICRO_PIN_1. HIGH, HIGH, LOW = 1/8 step
+#define MICROSTEP_COARSE_PINS 0b001 // HIGH, LOW, LOW = 1/2 step
+#define MICROSTEP_RATIO 4           // Fine steps per coarse step
+#define STEP_GAP_BUCKETS 96         // Inter-step gap histogram, 4 buckets per power of two up to 16 s
+
+// Settings for motion_profile.h
+#define MOTION_PROFILE_TRAPEZOID 0 // Constant acceleration
+#define MOTION_PROFILE_SCURVE 1    // Smoothstep velocity ramp, no acceleration step at the ends
+#ifndef MOTION_PROFILE
+#define MOTION_PROFILE MOTION_PROFILE_TRAPEZOID
+#endif
+#define MOTOR_START_SPEED 1000 // Speed the motor can start at without stalling
+#define MOTOR_ACCEL 20000      // Steps per second squared
+#define MOTION_RAMP_TABLE_SIZE 128
+#define MICROSTEP_COARSE_SPEED 4000 // Fine steps per second from where coarse steps are used
+#define MICROSTEP_FINE_ZONE 1600    // Fine steps before the end of a bounded move that are always fine
 
 // Settings for mqtt_control.h
 //#define MQTT_SERVER_IP "192.168.1.18"
@@ -51,19 +136,86 @@ String UPDATE_TOPIC = String(CLIENT_ID) + "/UPDATE";
 String TEMP_REQUEST_TOPIC = "TEMP_REQUEST";
 String STATE_TOPIC = "STATE";
 String TEMP_TOPIC = "TEMP";
+String TEMP_SENSOR_TOPICS[TEMPERATURE_MAX_SENSORS]; // TEMP, TEMP/1, ..., filled in by MqttControl::begin(), sensor 0 keeps the old topic
 String FIRMWARE_VERSION_TOPIC = "FIRMWARE_VER";
-#define MQTT_CONNECT_TRY_INTERVAL 25000
-#define MQTT_TEMP_INTERVAL 60000
+String POSITION_TOPIC = "POSITION";
+String TELEMETRY_TOPIC = String(CLIENT_ID) + "/TELEMETRY";
+String TEMP_HISTORY_TOPIC = String(CLIENT_ID) + "/TEMP_HISTORY";
+String THERMOSTAT_TOPIC = String(CLIENT_ID) + "/THERMOSTAT";
+String THERMOSTAT_STATE_TOPIC = "THERMOSTAT_STATE";
+#if LOOP_PROFILER
+String LOOP_PROFILE_TOPIC = String(CLIENT_ID) + "/LOOP_PROFILE";
+#endif
+#define MQTT_BACKOFF_MIN 2000          // ms before the first retry, doubles per failed attempt
+#define MQTT_BACKOFF_MAX 120000        // ms, longest wait between attempts
+#define MQTT_DNS_TIMEOUT 5000          // ms to wait for the broker name to resolve
+#define MQTT_TCP_CONNECT_TIMEOUT 500   // ms
+#define MQTT_SOCKET_TIMEOUT 1          // s to wait for CONNACK
+#define MQTT_TEMP_DEADBAND 9        // 1/16 C a reading has to move before it is published, about 1 F
+#define MQTT_TEMP_MAX_AGE 900000    // ms, a reading is published at least this often
+#ifndef MQTT_TEMP_PAYLOAD_RAW
+#define MQTT_TEMP_PAYLOAD_RAW 0     // 1 publishes temperatures as a little endian int16 of 1/16 C instead of text in F
+#endif
+#define MQTT_BUFFER_SIZE 2560    // Large enough for a batch of move records and the temperature history
+#define MQTT_TELEMETRY_BATCH 6   // Move records per telemetry message
+
+// Settings for mqtt_outbox.h
+#define MQTT_OUTBOX_SIZE 8        // Topics that can be pending at once
+#define MQTT_OUTBOX_VALUE_SIZE 24 // Longest payload, state names and numbers
+#define MQTT_OUTBOX_BATCH 4       // Messages sent per handle()
+
+// Settings for mqtt_dispatch.h
+#define MQTT_DISPATCH_MAX_TOPICS 8
+#define MQTT_DISPATCH_MAX_PAYLOAD 32 // Longest payload kept for the log, commands are shorter
+
+// Settings for binary_log.h
+#ifndef BINARY_LOG
+#define BINARY_LOG 0 // 1 writes LOG_EVENT() sites as binary records for tools/log_decoder.cpp
+#endif
+#define BINARY_LOG_MARKER 0xFE    // Starts a record, never part of the text log
+#define BINARY_LOG_MAX_RECORD 64  // Bytes, arguments past this are dropped
+
+// Settings for loop_profiler.h
+#ifndef LOOP_PROFILER
+#define LOOP_PROFILER 0 // 1 times every handle() in loop(), 0 compiles the profiler out
+#endif
+#define LOOP_PROFILER_PUBLISH_INTERVAL 0 // Publish and reset the profile over MQTT every n ms, 0 disables
+
+// Settings for event_bus.h
+#define EVENT_BUS_MAX_SUBSCRIBERS 12
+#define EVENT_BUS_QUEUE_SIZE 16 // Must be a power of two
+
+// Settings for scheduler.h
+#define SCHEDULER_MAX_TASKS 12
+#define LED_HANDLE_PERIOD 20 // ms between runs of each module's handle()
+#define TEMPERATURE_HANDLE_PERIOD 50
+#define UTILITIES_HANDLE_PERIOD 100
+#define OTA_HANDLE_PERIOD 50
+#define REMOTE_HANDLE_PERIOD 5
+#define MQTT_HANDLE_PERIOD 10
+#define EVENT_BUS_HANDLE_PERIOD 0 // Deliver events on every pass
+#define TELNET_HANDLE_PERIOD 20
 
 // Settings for remote_control.h
 #define MANUAL_OPEN_BUTTON 32
 #define MANUAL_CLOSE_BUTTON 33
 
+// Settings for async_log.h
+#define ASYNC_LOG_BUFFER_SIZE 4096 // Bytes, must be a power of two
+#define ASYNC_LOG_INPUT_SIZE 64    // Telnet command bytes, must be a power of two
+#define ASYNC_LOG_DRAIN_PERIOD 10  // ms between drain passes
+#define ASYNC_LOG_FLUSH_TIMEOUT 500
+#define ASYNC_LOG_TASK_CORE 0      // Away from the motion task
+#define ASYNC_LOG_TASK_PRIORITY 1
+#define ASYNC_LOG_TASK_STACK_SIZE 3072
+
 // ----- END Static Controller Settings -----
 
 // ----- Global Objects -----
 #include <TelnetSpy.h>
-TelnetSpy LOG;
+#include "async_log.h"
+TelnetSpy telnetSpy;
+AsyncLog LOG(telnetSpy);
 
 #include <WiFi.h>
 #include <DNSServer.h>
@@ -90,4 +242,7 @@ Bounce closeDebouncer;
 
 #include <ArduinoOTA.h>
 #include <FastLED.h>
+
+#include <Preferences.h>
+Preferences preferences;
 // ----- END Global Objects -----
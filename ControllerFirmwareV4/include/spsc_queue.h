@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+
+// Fixed size single-producer/single-consumer lock-free queue.
+// Exactly one task may push() and exactly one task may pop(), which lets the
+// two sides run on different cores without taking a lock.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+private:
+    T buffer[Capacity];
+    std::atomic<size_t> head; // Next slot to write, only advanced by the producer
+    std::atomic<size_t> tail; // Next slot to read, only advanced by the consumer
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // Producer side, returns false if the queue is full
+    bool push(const T &item)
+    {
+        size_t currentHead = head.load(std::memory_order_relaxed);
+
+        if (currentHead - tail.load(std::memory_order_acquire) >= Capacity)
+        {
+            return false;
+        }
+
+        buffer[currentHead & (Capacity - 1)] = item;
+        head.store(currentHead + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, returns false if the queue is empty
+    bool pop(T &item)
+    {
+        size_t currentTail = tail.load(std::memory_order_relaxed);
+
+        if (currentTail == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = buffer[currentTail & (Capacity - 1)];
+        tail.store(currentTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, like pop() but leaves the item in the queue
+    bool peek(T &item) const
+    {
+        size_t currentTail = tail.load(std::memory_order_relaxed);
+
+        if (currentTail == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = buffer[currentTail & (Capacity - 1)];
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+};
@@ -0,0 +1,670 @@
+#pragma once
+#include "shared.h"
+#include "motion_profile.h"
+#include <soc/gpio_struct.h>
+
+#if STEP_BACKEND == STEP_BACKEND_RMT
+#include <driver/rmt.h>
+#include <soc/rmt_struct.h>
+#endif
+
+// Generates the step pulses for the stepper driver.
+// The timer backend toggles STEP_PIN from a hardware timer ISR so the pulse
+// rate does not depend on how fast loop() comes around. The RMT backend hands
+// the pulses to the RMT peripheral in batches. The motion task plans the next
+// batch from run() while the current one is sent, the TX end interrupt only
+// starts it with register writes.
+// The polled backend is the original AccelStepper::runSpeed() path and needs
+// run() every loop pass. All of them take their step intervals from MotionProfile.
+// With ADAPTIVE_MICROSTEPPING the driver is switched to coarse steps while the
+// motor is fast and back to fine steps before the end of the move. Mode changes
+// only happen between pulses and the position stays in fine steps throughout.
+class StepEngine
+{
+private:
+    static volatile bool running;
+    static float speed;
+    static volatile int32_t position;     // Fine steps from the closed endstop
+    static volatile int8_t stepDirection; // Position change per fine step
+    static volatile uint8_t stepSize;     // Fine steps per pulse in the current microstep mode
+
+    // Gaps between step pulses of the current move, in microseconds
+    static volatile uint32_t gapHistogram[STEP_GAP_BUCKETS];
+    static volatile uint32_t maxGap;
+    static volatile uint32_t lastStepCycles;
+    static volatile bool gapStarted;
+    static uint32_t cyclesPerMicro;
+
+    static uint8_t IRAM_ATTR getGapBucket(uint32_t gap);
+    static uint32_t getGapBucketLimit(uint8_t bucket);
+    static void IRAM_ATTR recordGap(uint32_t gap);
+    static void IRAM_ATTR recordStepTime();
+    static void resetGapStats();
+
+    static constexpr uint32_t microstepPinMask(uint8_t levels, bool high);
+    static void IRAM_ATTR setMicrostepMode(bool coarse);
+    static bool IRAM_ATTR wantsModeChange(int32_t atPosition, uint8_t atStepSize);
+
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+    static hw_timer_t *stepTimer;
+    static volatile bool stepLevel;
+    static volatile uint32_t stepInterval; // Interval of the step being output
+    static volatile uint32_t nextStepInterval;
+
+    static void IRAM_ATTR onStepTimer();
+#elif STEP_BACKEND == STEP_BACKEND_RMT
+    struct RmtBatch
+    {
+        rmt_item32_t items[STEP_RMT_BATCH_SIZE + 1];
+        uint32_t count;   // Steps in the batch, 0 ends the move
+        uint8_t stepSize; // Fine steps per pulse, the mode is set before the batch starts
+    };
+
+    static RmtBatch rmtBatches[2];
+    static volatile uint8_t activeBatch;       // Batch being sent
+    static volatile bool nextBatchReady;       // The other batch is planned and waits for the channel
+    static volatile bool rmtIdle;              // The channel ran dry before the next batch was planned
+    static volatile uint32_t batchStartCycles;
+    static volatile uint32_t rmtIdleCycles;     // When the channel ran dry
+    static int32_t plannedPosition;            // Position once every planned batch has been sent
+    static uint8_t plannedStepSize;
+    static portMUX_TYPE rmtMux;
+
+    static void planRmtBatch(RmtBatch &batch);
+    static void IRAM_ATTR sendRmtBatch(const RmtBatch &batch);
+    static void IRAM_ATTR haltRmt();
+    static void IRAM_ATTR onRmtTxEnd(rmt_channel_t channel, void *arg);
+#endif
+
+public:
+    // True when step timing depends on run() being called from the loop
+    static constexpr bool requiresLoop = (STEP_BACKEND == STEP_BACKEND_POLLED);
+
+    static void begin();
+    static void setSpeed(float stepsPerSecond); // Cruise speed of the next move, positive closes, negative opens
+    static void start(uint32_t distance = MotionProfile::UNBOUNDED_MOVE, bool untilEndstop = false);
+    static void decelerate(); // Ramp down and stop
+    static void stop();       // Stop right away
+    static void IRAM_ATTR onEndstopTriggered(bool closedEndstop);
+    static void run();
+    static bool isRunning();
+    static bool isClosing();
+    static int32_t getPosition();
+    static void setPosition(int32_t newPosition);
+    static uint32_t getMaxGap();                          // Longest gap between steps of the last move, in us
+    static uint32_t getGapPercentile(uint8_t percentile); // Upper bound of the gap bucket holding the percentile, in us
+};
+
+// Static member definitions
+volatile bool StepEngine::running = false;
+float StepEngine::speed = 0.0f;
+volatile int32_t StepEngine::position = 0;
+volatile int8_t StepEngine::stepDirection = 1;
+volatile uint8_t StepEngine::stepSize = 1;
+volatile uint32_t StepEngine::gapHistogram[STEP_GAP_BUCKETS];
+volatile uint32_t StepEngine::maxGap = 0U;
+volatile uint32_t StepEngine::lastStepCycles = 0U;
+volatile bool StepEngine::gapStarted = false;
+uint32_t StepEngine::cyclesPerMicro = 240U;
+
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+hw_timer_t *StepEngine::stepTimer = NULL;
+volatile bool StepEngine::stepLevel = false;
+volatile uint32_t StepEngine::stepInterval = 0U;
+volatile uint32_t StepEngine::nextStepInterval = 0U;
+#elif STEP_BACKEND == STEP_BACKEND_RMT
+StepEngine::RmtBatch StepEngine::rmtBatches[2];
+volatile uint8_t StepEngine::activeBatch = 0;
+volatile bool StepEngine::nextBatchReady = false;
+volatile bool StepEngine::rmtIdle = false;
+volatile uint32_t StepEngine::batchStartCycles = 0U;
+volatile uint32_t StepEngine::rmtIdleCycles = 0U;
+int32_t StepEngine::plannedPosition = 0;
+uint8_t StepEngine::plannedStepSize = 1;
+portMUX_TYPE StepEngine::rmtMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// Private methods
+constexpr uint32_t StepEngine::microstepPinMask(uint8_t levels, bool high)
+{
+    return ((((levels >> 0) & 1) != 0) == high ? (1UL << MICRO_PIN_1) : 0) |
+           ((((levels >> 1) & 1) != 0) == high ? (1UL << MICRO_PIN_2) : 0) |
+           ((((levels >> 2) & 1) != 0) == high ? (1UL << MICRO_PIN_3) : 0);
+}
+
+void IRAM_ATTR StepEngine::setMicrostepMode(bool coarse)
+{
+    constexpr uint32_t fineHigh = microstepPinMask(MICROSTEP_FINE_PINS, true);
+    constexpr uint32_t fineLow = microstepPinMask(MICROSTEP_FINE_PINS, false);
+    constexpr uint32_t coarseHigh = microstepPinMask(MICROSTEP_COARSE_PINS, true);
+    constexpr uint32_t coarseLow = microstepPinMask(MICROSTEP_COARSE_PINS, false);
+
+    GPIO.out_w1ts = coarse ? coarseHigh : fineHigh;
+    GPIO.out_w1tc = coarse ? coarseLow : fineLow;
+    stepSize = coarse ? MICROSTEP_RATIO : 1;
+}
+
+uint8_t IRAM_ATTR StepEngine::getGapBucket(uint32_t gap)
+{
+    // Four linear buckets per power of two, so the percentiles are within 25%
+    if (gap < 8)
+    {
+        return gap;
+    }
+
+    uint32_t msb = 31 - __builtin_clz(gap);
+    uint32_t bucket = msb * 4 + ((gap >> (msb - 2)) & 3);
+    return bucket < STEP_GAP_BUCKETS ? bucket : STEP_GAP_BUCKETS - 1;
+}
+
+uint32_t StepEngine::getGapBucketLimit(uint8_t bucket)
+{
+    if (bucket < 8)
+    {
+        return bucket;
+    }
+
+    uint32_t msb = bucket / 4;
+    return ((5 + bucket % 4) << (msb - 2)) - 1;
+}
+
+void IRAM_ATTR StepEngine::recordGap(uint32_t gap)
+{
+    uint8_t bucket = getGapBucket(gap);
+    gapHistogram[bucket] = gapHistogram[bucket] + 1;
+
+    if (gap > maxGap)
+    {
+        maxGap = gap;
+    }
+}
+
+void IRAM_ATTR StepEngine::recordStepTime()
+{
+    uint32_t now = ESP.getCycleCount();
+
+    if (gapStarted)
+    {
+        recordGap((now - lastStepCycles) / cyclesPerMicro);
+    }
+
+    lastStepCycles = now;
+    gapStarted = true;
+}
+
+void StepEngine::resetGapStats()
+{
+    for (uint8_t i = 0; i < STEP_GAP_BUCKETS; i++)
+    {
+        gapHistogram[i] = 0;
+    }
+    maxGap = 0;
+    gapStarted = false;
+}
+
+bool IRAM_ATTR StepEngine::wantsModeChange(int32_t atPosition, uint8_t atStepSize)
+{
+#if ADAPTIVE_MICROSTEPPING
+    bool coarse = atStepSize > 1;
+    if (coarse)
+    {
+        return !MotionProfile::isCoarseAllowed();
+    }
+
+    // Only go coarse on a coarse step boundary so the driver stays on the coarse grid
+    return MotionProfile::isCoarseAllowed() && atPosition % MICROSTEP_RATIO == 0;
+#else
+    return false;
+#endif
+}
+
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+void IRAM_ATTR StepEngine::onStepTimer()
+{
+    // Two timer periods per step, the driver steps on the rising edge
+    if (stepLevel)
+    {
+        GPIO.out_w1tc = (1UL << STEP_PIN);
+        stepLevel = false;
+
+        // Hold low for the rest of the interval
+        timerAlarmWrite(stepTimer, stepInterval - stepInterval / 2, true);
+
+        // Prepare the next step now, this leaves the driver half a step to see a mode change
+        if (wantsModeChange(position, stepSize))
+        {
+            setMicrostepMode(stepSize == 1);
+        }
+        nextStepInterval = MotionProfile::nextInterval(stepSize);
+        return;
+    }
+
+    if (nextStepInterval == 0)
+    {
+        // Move finished
+        timerAlarmDisable(stepTimer);
+        running = false;
+        return;
+    }
+
+    GPIO.out_w1ts = (1UL << STEP_PIN);
+    stepLevel = true;
+    stepInterval = nextStepInterval;
+    position = position + stepDirection * stepSize;
+    recordStepTime();
+
+    // Takes effect for the current period since the counter was just reloaded
+    timerAlarmWrite(stepTimer, stepInterval / 2, true);
+}
+#elif STEP_BACKEND == STEP_BACKEND_RMT
+void StepEngine::planRmtBatch(RmtBatch &batch)
+{
+    uint8_t size = plannedStepSize;
+    batch.count = 0;
+
+    // Mode changes only happen between batches
+    if (wantsModeChange(plannedPosition, size))
+    {
+        size = size == 1 ? MICROSTEP_RATIO : 1;
+    }
+
+    while (batch.count < STEP_RMT_BATCH_SIZE)
+    {
+        if (batch.count > 0 && wantsModeChange(plannedPosition, size))
+        {
+            // End the batch early so the change happens before the next one
+            break;
+        }
+
+        uint32_t interval = MotionProfile::nextInterval(size);
+        if (interval == 0)
+        {
+            break;
+        }
+
+        if (batch.count > 0)
+        {
+            // The RMT peripheral outputs the queued timing exactly, so within a
+            // batch that is the gap. The one after the last step is recorded
+            // once the next batch starts.
+            const rmt_item32_t &previous = batch.items[batch.count - 1];
+            recordGap(previous.duration0 + previous.duration1);
+        }
+
+        // One item per step, high for the first half of the interval
+        rmt_item32_t &item = batch.items[batch.count];
+        item.level0 = 1;
+        item.duration0 = interval / 2;
+        item.level1 = 0;
+        item.duration1 = interval - interval / 2;
+        batch.count++;
+        plannedPosition += stepDirection * size;
+    }
+
+    // A zero length item ends the transmission
+    batch.items[batch.count].val = 0;
+    batch.stepSize = size;
+    plannedStepSize = size;
+}
+
+void IRAM_ATTR StepEngine::sendRmtBatch(const RmtBatch &batch)
+{
+    // Register writes only, the driver calls are not safe from an interrupt
+    if (batch.stepSize != stepSize)
+    {
+        setMicrostepMode(batch.stepSize > 1);
+    }
+
+    for (uint32_t i = 0; i <= batch.count; i++)
+    {
+        RMTMEM.chan[STEP_RMT_CHANNEL].data32[i].val = batch.items[i].val;
+    }
+
+    RMT.conf_ch[STEP_RMT_CHANNEL].conf1.mem_rd_rst = 1;
+    RMT.conf_ch[STEP_RMT_CHANNEL].conf1.mem_rd_rst = 0;
+    batchStartCycles = ESP.getCycleCount();
+    RMT.conf_ch[STEP_RMT_CHANNEL].conf1.tx_start = 1;
+}
+
+void IRAM_ATTR StepEngine::haltRmt()
+{
+    // An end marker where the read pointer restarts stops the channel at the next item
+    RMTMEM.chan[STEP_RMT_CHANNEL].data32[0].val = 0;
+    RMT.conf_ch[STEP_RMT_CHANNEL].conf1.tx_start = 0;
+    RMT.conf_ch[STEP_RMT_CHANNEL].conf1.mem_rd_rst = 1;
+    RMT.conf_ch[STEP_RMT_CHANNEL].conf1.mem_rd_rst = 0;
+
+    if (!rmtIdle)
+    {
+        // Only the steps of the active batch whose rising edge already went out count
+        const RmtBatch &batch = rmtBatches[activeBatch];
+        uint32_t elapsed = (ESP.getCycleCount() - batchStartCycles) / cyclesPerMicro;
+        uint32_t sent = 0;
+        uint32_t edge = 0;
+
+        while (sent < batch.count && edge <= elapsed)
+        {
+            edge += batch.items[sent].duration0 + batch.items[sent].duration1;
+            sent++;
+        }
+
+        position = position + stepDirection * (int32_t)(sent * batch.stepSize);
+    }
+
+    running = false;
+    nextBatchReady = false;
+    rmtIdle = false;
+}
+
+void IRAM_ATTR StepEngine::onRmtTxEnd(rmt_channel_t channel, void *arg)
+{
+    if (channel != STEP_RMT_CHANNEL)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL_ISR(&rmtMux);
+    if (running && !rmtIdle)
+    {
+        // The whole batch went out
+        const RmtBatch &sent = rmtBatches[activeBatch];
+        position = position + stepDirection * (int32_t)(sent.count * sent.stepSize);
+
+        if (!nextBatchReady)
+        {
+            // run() starts the next batch once it is planned, the pulses stall until then
+            rmtIdle = true;
+            rmtIdleCycles = ESP.getCycleCount();
+        }
+        else
+        {
+            const rmt_item32_t &last = sent.items[sent.count - 1];
+            recordGap(last.duration0 + last.duration1);
+            activeBatch = activeBatch ^ 1;
+            nextBatchReady = false;
+
+            if (rmtBatches[activeBatch].count == 0)
+            {
+                // Move finished
+                running = false;
+            }
+            else
+            {
+                sendRmtBatch(rmtBatches[activeBatch]);
+            }
+        }
+    }
+    portEXIT_CRITICAL_ISR(&rmtMux);
+}
+#endif
+
+// Public methods
+void StepEngine::begin()
+{
+    pinMode(MICRO_PIN_1, OUTPUT);
+    pinMode(MICRO_PIN_2, OUTPUT);
+    pinMode(MICRO_PIN_3, OUTPUT);
+    setMicrostepMode(false);
+
+    cyclesPerMicro = getCpuFrequencyMhz();
+
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+    pinMode(STEP_PIN, OUTPUT);
+    digitalWrite(STEP_PIN, LOW);
+    pinMode(DIR_PIN, OUTPUT);
+
+    stepTimer = timerBegin(STEP_TIMER_NUM, STEP_TIMER_DIVIDER, true);
+    timerAttachInterrupt(stepTimer, &onStepTimer, true);
+#elif STEP_BACKEND == STEP_BACKEND_RMT
+    pinMode(DIR_PIN, OUTPUT);
+
+    rmt_config_t config = {};
+    config.rmt_mode = RMT_MODE_TX;
+    config.channel = STEP_RMT_CHANNEL;
+    config.gpio_num = (gpio_num_t)STEP_PIN;
+    config.mem_block_num = 1;
+    config.clk_div = STEP_TIMER_DIVIDER; // Same 1us ticks as the step timer
+    config.tx_config.loop_en = false;
+    config.tx_config.carrier_en = false;
+    config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+    config.tx_config.idle_output_en = true;
+
+    rmt_config(&config);
+    rmt_driver_install(STEP_RMT_CHANNEL, 0, 0);
+    rmt_register_tx_end_callback(onRmtTxEnd, NULL);
+    rmt_set_tx_intr_en(STEP_RMT_CHANNEL, true); // Batches are started without the driver, which would enable it
+
+#else
+    stepper = AccelStepper(1, STEP_PIN, DIR_PIN);
+    stepper.setMaxSpeed(MAX_MOTOR_SPEED);
+#endif
+
+    setSpeed(MOTOR_SPEED);
+}
+
+void StepEngine::setSpeed(float stepsPerSecond)
+{
+    speed = constrain(stepsPerSecond, -MAX_MOTOR_SPEED, MAX_MOTOR_SPEED);
+    stepDirection = speed > 0 ? -1 : 1;
+
+#if STEP_BACKEND != STEP_BACKEND_POLLED
+    // Same direction convention as AccelStepper, DIR is high for positive speeds
+    digitalWrite(DIR_PIN, speed > 0 ? HIGH : LOW);
+#endif
+}
+
+void StepEngine::start(uint32_t distance, bool untilEndstop)
+{
+    if (running || speed == 0.0f || (distance == 0 && !untilEndstop))
+    {
+        return;
+    }
+
+    // Every move starts slow, so in fine steps
+    setMicrostepMode(false);
+    resetGapStats();
+    MotionProfile::start(fabsf(speed), distance, untilEndstop);
+    running = true;
+
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+    stepLevel = false;
+    nextStepInterval = MotionProfile::nextInterval(stepSize);
+    timerWrite(stepTimer, 0);
+    timerAlarmWrite(stepTimer, MotionProfile::getStartInterval() / 2, true);
+    timerAlarmEnable(stepTimer);
+#elif STEP_BACKEND == STEP_BACKEND_RMT
+    plannedPosition = position;
+    plannedStepSize = stepSize;
+    planRmtBatch(rmtBatches[0]);
+    if (rmtBatches[0].count == 0)
+    {
+        running = false;
+        return;
+    }
+
+    portENTER_CRITICAL(&rmtMux);
+    activeBatch = 0;
+    nextBatchReady = false;
+    rmtIdle = false;
+    sendRmtBatch(rmtBatches[0]);
+    portEXIT_CRITICAL(&rmtMux);
+
+    // run() plans the following batches until the move is finished or stopped
+    run();
+#else
+    // Every step is taken out of the profile before runSpeed() makes it
+    uint32_t interval = MotionProfile::nextInterval(stepSize);
+    float stepsPerSecond = STEP_TIMER_TICKS_PER_SECOND / interval;
+    stepper.setSpeed(speed > 0 ? stepsPerSecond : -stepsPerSecond);
+#endif
+}
+
+void StepEngine::decelerate()
+{
+    MotionProfile::requestStop();
+}
+
+void StepEngine::stop()
+{
+#if STEP_BACKEND != STEP_BACKEND_RMT
+    running = false;
+#endif
+
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+    timerAlarmDisable(stepTimer);
+    digitalWrite(STEP_PIN, LOW);
+    stepLevel = false;
+#elif STEP_BACKEND == STEP_BACKEND_RMT
+    portENTER_CRITICAL(&rmtMux);
+    if (running)
+    {
+        haltRmt();
+    }
+    portEXIT_CRITICAL(&rmtMux);
+#else
+    stepper.stop();
+#endif
+}
+
+void IRAM_ATTR StepEngine::onEndstopTriggered(bool closedEndstop)
+{
+    // Called from the endstop ISR, only the endstop in the direction of travel stops the move
+    if (!running || closedEndstop != (stepDirection < 0))
+    {
+        return;
+    }
+
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+    running = false;
+    timerAlarmDisable(stepTimer);
+    GPIO.out_w1tc = (1UL << STEP_PIN);
+    stepLevel = false;
+#elif STEP_BACKEND == STEP_BACKEND_RMT
+    portENTER_CRITICAL_ISR(&rmtMux);
+    if (running)
+    {
+        haltRmt();
+    }
+    portEXIT_CRITICAL_ISR(&rmtMux);
+#else
+    running = false;
+#endif
+    // The polled backend stops stepping in run() once running is cleared
+}
+
+void StepEngine::run()
+{
+#if STEP_BACKEND == STEP_BACKEND_RMT
+    if (!running || nextBatchReady)
+    {
+        return;
+    }
+
+    // Only this task touches the batch that is not being sent
+    RmtBatch &batch = rmtBatches[activeBatch ^ 1];
+    planRmtBatch(batch);
+
+    portENTER_CRITICAL(&rmtMux);
+    if (!running)
+    {
+        // Stopped while planning
+    }
+    else if (rmtIdle)
+    {
+        // The channel ran dry waiting for this batch, start it from here
+        rmtIdle = false;
+        const RmtBatch &sent = rmtBatches[activeBatch];
+        activeBatch = activeBatch ^ 1;
+        if (batch.count == 0)
+        {
+            running = false;
+        }
+        else
+        {
+            // The last step's interval plus the stall
+            const rmt_item32_t &last = sent.items[sent.count - 1];
+            recordGap(last.duration0 + last.duration1 + (ESP.getCycleCount() - rmtIdleCycles) / cyclesPerMicro);
+            sendRmtBatch(batch);
+        }
+    }
+    else
+    {
+        nextBatchReady = true;
+    }
+    portEXIT_CRITICAL(&rmtMux);
+#elif STEP_BACKEND == STEP_BACKEND_POLLED
+    if (running && stepper.runSpeed())
+    {
+        position = position + stepDirection * stepSize;
+        recordStepTime();
+
+        if (wantsModeChange(position, stepSize))
+        {
+            setMicrostepMode(stepSize == 1);
+        }
+
+        uint32_t interval = MotionProfile::nextInterval(stepSize);
+        if (interval == 0)
+        {
+            // Move finished
+            running = false;
+            return;
+        }
+
+        float stepsPerSecond = STEP_TIMER_TICKS_PER_SECOND / interval;
+        stepper.setSpeed(speed > 0 ? stepsPerSecond : -stepsPerSecond);
+    }
+#endif
+}
+
+bool StepEngine::isRunning()
+{
+    return running;
+}
+
+bool StepEngine::isClosing()
+{
+    return speed > 0;
+}
+
+int32_t StepEngine::getPosition()
+{
+    return position;
+}
+
+void StepEngine::setPosition(int32_t newPosition)
+{
+    position = newPosition;
+}
+
+uint32_t StepEngine::getMaxGap()
+{
+    return maxGap;
+}
+
+uint32_t StepEngine::getGapPercentile(uint8_t percentile)
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < STEP_GAP_BUCKETS; i++)
+    {
+        total += gapHistogram[i];
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint32_t rank = (uint32_t)(((uint64_t)total * percentile + 99) / 100);
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < STEP_GAP_BUCKETS; i++)
+    {
+        seen += gapHistogram[i];
+        if (seen >= rank)
+        {
+            return min(getGapBucketLimit(i), (uint32_t)maxGap);
+        }
+    }
+
+    return maxGap;
+}
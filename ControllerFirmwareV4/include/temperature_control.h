@@ -1,44 +1,258 @@
 #pragma once
 #include "shared.h"
+#include "event_bus.h"
+#include "binary_log.h"
+#include "temperature_format.h"
 
+// The DS18B20s are sampled in the background: handle() starts one
+// conversion for every sensor on the bus without waiting for it and collects
+// the results once the conversion time has passed. getCurrentTemp() only
+// returns the cached readings, in raw 1/16 C.
+// A sensor's index is its role (THERMOSTAT_SENSOR, the TEMP topics). Roles
+// follow the ROM address, kept in NVS, so adding a probe to the bus does not
+// shift the others. A new probe takes the first unused index, or the index
+// of a probe that is no longer found.
 class TemparatureControl
 {
 private:
-    static unsigned long lastTempReading;
+    static unsigned long lastTempReading;    // millis() of the cached readings
+    static unsigned long conversionStart;
+    static bool conversionPending;
+    static uint8_t sensorCount;
+    static TemperatureRaw currentTemp[TEMPERATURE_MAX_SENSORS];
+    static DeviceAddress sensorAddresses[TEMPERATURE_MAX_SENSORS]; // By role, all zero if unused
+    static bool sensorPresent[TEMPERATURE_MAX_SENSORS];            // Found on the bus at boot, reads skip the bus search
+    static uint16_t conversionTime;          // ms for the configured resolution
+
+    static void startConversion();
+    static void collectConversion();
+    static void assignSensors(); // Matches the sensors on the bus to their saved roles
+    static bool isUnused(const DeviceAddress address);
+    static void formatAddress(const DeviceAddress address, char *buffer, size_t size);
+
 public:
     // Methods
     static void begin();
     static void handle();
-    static float getCurrentTempF();
+    static uint8_t getSensorCount();
+    static TemperatureRaw getCurrentTemp(uint8_t sensor = 0);
+    static unsigned long getReadingAge(); // ms since the cached readings were taken
 };
 
 // Static member definitions
 unsigned long TemparatureControl::lastTempReading = 0U;
+unsigned long TemparatureControl::conversionStart = 0U;
+bool TemparatureControl::conversionPending = false;
+uint8_t TemparatureControl::sensorCount = 0U;
+TemperatureRaw TemparatureControl::currentTemp[TEMPERATURE_MAX_SENSORS];
+DeviceAddress TemparatureControl::sensorAddresses[TEMPERATURE_MAX_SENSORS];
+bool TemparatureControl::sensorPresent[TEMPERATURE_MAX_SENSORS];
+uint16_t TemparatureControl::conversionTime = 0U;
+
+// Private methods
+void TemparatureControl::startConversion()
+{
+    // Skip ROM, every sensor converts at once
+    sensors.requestTemperatures();
+    conversionStart = millis();
+    conversionPending = true;
+}
+
+void TemparatureControl::collectConversion()
+{
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+        if (!sensorPresent[i])
+        {
+            continue;
+        }
+
+        // The library reads in 1/128 C, the sensor itself has no more than 1/16 C
+        int16_t reading = sensors.getTemp(sensorAddresses[i]);
+        currentTemp[i] = reading <= DEVICE_DISCONNECTED_RAW ? TEMPERATURE_RAW_DISCONNECTED : reading / (128 / TEMPERATURE_RAW_PER_C);
+    }
+    lastTempReading = conversionStart;
+    conversionPending = false;
+}
+
+void TemparatureControl::assignSensors()
+{
+    preferences.begin(TEMPERATURE_PREFERENCES_NAMESPACE, true);
+    if (preferences.getBytesLength("addresses") == sizeof(sensorAddresses))
+    {
+        preferences.getBytes("addresses", sensorAddresses, sizeof(sensorAddresses));
+    }
+    preferences.end();
+
+    // Known sensors keep their role
+    uint8_t found = sensors.getDeviceCount();
+    bool changed = false;
+    DeviceAddress address;
+    for (uint8_t index = 0; index < found; index++)
+    {
+        if (!sensors.getAddress(address, index))
+        {
+            continue;
+        }
+
+        for (uint8_t i = 0; i < TEMPERATURE_MAX_SENSORS; i++)
+        {
+            if (memcmp(address, sensorAddresses[i], sizeof(DeviceAddress)) == 0)
+            {
+                sensorPresent[i] = true;
+            }
+        }
+    }
 
+    // New ones take an unused role first, then the role of a sensor that is gone
+    for (uint8_t index = 0; index < found; index++)
+    {
+        if (!sensors.getAddress(address, index))
+        {
+            continue;
+        }
+
+        int8_t unused = -1;
+        int8_t gone = -1;
+        bool known = false;
+        for (int8_t i = TEMPERATURE_MAX_SENSORS - 1; i >= 0; i--)
+        {
+            if (memcmp(address, sensorAddresses[i], sizeof(DeviceAddress)) == 0)
+            {
+                known = true;
+            }
+            else if (isUnused(sensorAddresses[i]))
+            {
+                unused = i;
+            }
+            else if (!sensorPresent[i])
+            {
+                gone = i;
+            }
+        }
+
+        if (known)
+        {
+            continue;
+        }
+
+        int8_t role = unused >= 0 ? unused : gone;
+        if (role < 0)
+        {
+            LOG_EVENT("More than %u temperature sensors found, the extra ones are not read.\n", (unsigned int)TEMPERATURE_MAX_SENSORS);
+            break;
+        }
+
+        memcpy(sensorAddresses[role], address, sizeof(DeviceAddress));
+        sensorPresent[role] = true;
+        changed = true;
+    }
+
+    if (changed)
+    {
+        preferences.begin(TEMPERATURE_PREFERENCES_NAMESPACE, false);
+        preferences.putBytes("addresses", sensorAddresses, sizeof(sensorAddresses));
+        preferences.end();
+    }
+
+    // Roles up to the last one in use are read, missing sensors read as disconnected
+    for (uint8_t i = 0; i < TEMPERATURE_MAX_SENSORS; i++)
+    {
+        currentTemp[i] = TEMPERATURE_RAW_DISCONNECTED;
+        if (!isUnused(sensorAddresses[i]))
+        {
+            sensorCount = i + 1;
+
+            char text[24];
+            formatAddress(sensorAddresses[i], text, sizeof(text));
+            LOG_EVENT("Temperature sensor %u is %s%s.\n", (unsigned int)i, text, sensorPresent[i] ? "" : ", not found");
+        }
+    }
+}
+
+bool TemparatureControl::isUnused(const DeviceAddress address)
+{
+    for (uint8_t i = 0; i < sizeof(DeviceAddress); i++)
+    {
+        if (address[i] != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TemparatureControl::formatAddress(const DeviceAddress address, char *buffer, size_t size)
+{
+    snprintf(buffer, size, "%02X%02X%02X%02X%02X%02X%02X%02X",
+             address[0], address[1], address[2], address[3], address[4], address[5], address[6], address[7]);
+}
 
 // Public methods
 void TemparatureControl::begin()
 {
-    sensors.setResolution(9);
     sensors.begin();
-    sensors.requestTemperatures();
+    assignSensors();
+
+    if (sensorCount == 0)
+    {
+        LOG_EVENT("No temperature sensor found.\n");
+    }
+
+    sensors.setResolution(TEMPERATURE_RESOLUTION);
+    conversionTime = sensors.millisToWaitForConversion(TEMPERATURE_RESOLUTION);
+
+    // The first readings wait for their conversion so there is always a cached value
+    sensors.setWaitForConversion(true);
+    startConversion();
+    collectConversion();
+    sensors.setWaitForConversion(false);
 }
 
 void TemparatureControl::handle()
 {
-    if (LOG_TEMPERATURE)
+    if (sensorCount == 0)
+    {
+        return;
+    }
+
+    if (conversionPending)
     {
-        if (millis() - lastTempReading >= 10000)
+        if (millis() - conversionStart < conversionTime)
         {
-            LOG.print("Temperature Reading: ");
-            LOG.println(getCurrentTempF());
-            lastTempReading = millis();
+            return;
+        }
+
+        collectConversion();
+        for (uint8_t i = 0; i < sensorCount; i++)
+        {
+            EventBus::publish(Event::temperatureRead(i, currentTemp[i]));
+
+            if (LOG_TEMPERATURE)
+            {
+                char temperature[12];
+                TemperatureFormat::formatF(currentTemp[i], 2, temperature, sizeof(temperature));
+                LOG_EVENT("Temperature Reading %u: %s\n", (unsigned int)i, temperature);
+            }
         }
     }
+    else if (millis() - lastTempReading >= TEMPERATURE_READ_INTERVAL)
+    {
+        startConversion();
+    }
 }
 
-float TemparatureControl::getCurrentTempF()
+uint8_t TemparatureControl::getSensorCount()
 {
-    sensors.requestTemperatures();
-    return sensors.getTempFByIndex(0);
-}
\ No newline at end of file
+    return sensorCount;
+}
+
+TemperatureRaw TemparatureControl::getCurrentTemp(uint8_t sensor)
+{
+    return sensor < sensorCount ? currentTemp[sensor] : TEMPERATURE_RAW_DISCONNECTED;
+}
+
+unsigned long TemparatureControl::getReadingAge()
+{
+    return millis() - lastTempReading;
+}
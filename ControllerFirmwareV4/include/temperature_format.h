@@ -0,0 +1,138 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+// Temperatures are kept as the DS18B20 reads them, a signed count of 1/16 C,
+// from the sensor through the history and the thermostat. Only the edges
+// turn them into text, into a caller's buffer and without floating point.
+// Only needs the C library, which lets tools/temperature_publish_bench.cpp
+// build it on the host.
+
+typedef int16_t TemperatureRaw;
+
+#define TEMPERATURE_RAW_PER_C 16
+#define TEMPERATURE_RAW_DISCONNECTED ((TemperatureRaw)(-127 * TEMPERATURE_RAW_PER_C)) // Reads as -196.6 F like DEVICE_DISCONNECTED_F
+
+// For settings given in F, the compiler does the arithmetic
+#define TEMPERATURE_RAW_FROM_F(f) ((TemperatureRaw)(((f) - 32.0) * TEMPERATURE_RAW_PER_C * 5.0 / 9.0 + ((f) >= 32.0 ? 0.5 : -0.5)))
+#define TEMPERATURE_RAW_DELTA_FROM_F(f) ((TemperatureRaw)((f) * TEMPERATURE_RAW_PER_C * 5.0 / 9.0 + 0.5))
+#define TEMPERATURE_HUNDREDTHS_FROM_F(f) ((int32_t)((f) * 100.0 + ((f) >= 0.0 ? 0.5 : -0.5)))
+
+class TemperatureFormat
+{
+private:
+    // One raw step is 9/80 F, so raw * 45 counts quarters of 1/100 F
+    static int32_t toQuarterHundredthsF(TemperatureRaw raw)
+    {
+        return (int32_t)raw * 45 + 3200 * 4;
+    }
+
+public:
+    // F with 0 to 2 decimals, rounded half away from zero. Returns the length
+    // like snprintf does.
+    static int formatF(TemperatureRaw raw, uint8_t decimals, char *buffer, size_t size)
+    {
+        int32_t scale = decimals >= 2 ? 1 : (decimals == 1 ? 10 : 100);
+        int32_t divisor = decimals >= 2 ? 100 : (decimals == 1 ? 10 : 1);
+        int32_t quarters = toQuarterHundredthsF(raw);
+        bool negative = quarters < 0;
+        int32_t magnitude = ((negative ? -quarters : quarters) + scale * 2) / (scale * 4);
+
+        if (decimals == 0)
+        {
+            return snprintf(buffer, size, "%s%ld", negative && magnitude != 0 ? "-" : "", (long)magnitude);
+        }
+
+        return snprintf(buffer, size, "%s%ld.%0*ld", negative && magnitude != 0 ? "-" : "",
+                        (long)(magnitude / divisor), (int)(decimals >= 2 ? 2 : 1), (long)(magnitude % divisor));
+    }
+
+    // F given in hundredths, as typed, without trailing zeros: "78", "74.5"
+    static int formatHundredthsF(int32_t hundredths, char *buffer, size_t size)
+    {
+        bool negative = hundredths < 0;
+        int32_t magnitude = negative ? -hundredths : hundredths;
+        int32_t fraction = magnitude % 100;
+
+        if (fraction == 0)
+        {
+            return snprintf(buffer, size, "%s%ld", negative ? "-" : "", (long)(magnitude / 100));
+        }
+        if (fraction % 10 == 0)
+        {
+            return snprintf(buffer, size, "%s%ld.%ld", negative ? "-" : "", (long)(magnitude / 100), (long)(fraction / 10));
+        }
+        return snprintf(buffer, size, "%s%ld.%02ld", negative ? "-" : "", (long)(magnitude / 100), (long)fraction);
+    }
+
+    // Nearest raw step, about 0.11 F apart
+    static TemperatureRaw fromHundredthsF(int32_t hundredths)
+    {
+        // raw = (F - 32) * 80 / 9, in hundredths of F
+        int32_t scaled = (hundredths - 3200) * 4;
+        return (TemperatureRaw)(scaled >= 0 ? (scaled + 22) / 45 : -((-scaled + 22) / 45));
+    }
+
+    // Parses F like "72", "-4.5" or "71.25" at the start of text, up to two
+    // decimals, further ones are dropped. Moves text past the number, false
+    // if there is none.
+    static bool parseHundredthsF(const char *&text, int32_t &hundredths)
+    {
+        const char *cursor = text;
+        while (*cursor == ' ')
+        {
+            cursor++;
+        }
+
+        bool negative = *cursor == '-';
+        if (negative)
+        {
+            cursor++;
+        }
+
+        if (*cursor < '0' || *cursor > '9')
+        {
+            return false;
+        }
+
+        hundredths = 0;
+        while (*cursor >= '0' && *cursor <= '9' && hundredths < 100000)
+        {
+            hundredths = hundredths * 10 + (*cursor++ - '0');
+        }
+        hundredths *= 100;
+
+        if (*cursor == '.')
+        {
+            cursor++;
+            for (int32_t place = 10; place > 0 && *cursor >= '0' && *cursor <= '9'; place /= 10)
+            {
+                hundredths += (*cursor++ - '0') * place;
+            }
+            while (*cursor >= '0' && *cursor <= '9')
+            {
+                cursor++;
+            }
+        }
+
+        if (negative)
+        {
+            hundredths = -hundredths;
+        }
+
+        text = cursor;
+        return true;
+    }
+
+    static bool parseF(const char *&text, TemperatureRaw &raw)
+    {
+        int32_t hundredths;
+        if (!parseHundredthsF(text, hundredths))
+        {
+            return false;
+        }
+
+        raw = fromHundredthsF(hundredths);
+        return true;
+    }
+};
@@ -0,0 +1,204 @@
+#pragma once
+#include "shared.h"
+#include "event_bus.h"
+#include "temperature_format.h"
+
+// Recent temperature readings per sensor in raw 1/16 C, kept so the server can backfill
+// after an outage. The last readings are kept as they were read, older ones
+// are rolled up into min/avg/max buckets of TEMPERATURE_HISTORY_BUCKET_PERIOD.
+// Buckets sit on a fixed grid from boot, a period without readings leaves an
+// empty bucket so the server can line them up by age.
+class TemperatureHistory
+{
+private:
+    struct Bucket
+    {
+        TemperatureRaw min;
+        TemperatureRaw avg;
+        TemperatureRaw max;
+        uint8_t count; // Readings rolled up, 0 for a period without any
+    };
+
+    struct SensorHistory
+    {
+        TemperatureRaw fine[TEMPERATURE_HISTORY_FINE_SIZE];
+        uint8_t fineNext;
+        uint8_t fineCount;
+        unsigned long lastSampleTime;
+
+        Bucket buckets[TEMPERATURE_HISTORY_BUCKETS];
+        uint8_t bucketNext;
+        uint8_t bucketCount;
+        unsigned long bucketStart; // Start of the bucket being filled
+
+        // Bucket being filled
+        TemperatureRaw min;
+        TemperatureRaw max;
+        int32_t sum;
+        uint8_t count;
+    };
+
+    static SensorHistory history[TEMPERATURE_MAX_SENSORS];
+
+    static void onTemperatureEvent(const Event &event);
+    static void closeBucket(SensorHistory &sensor);
+
+public:
+    static void begin();
+    static void add(uint8_t sensor, TemperatureRaw temperature);
+    static size_t formatJson(char *buffer, size_t size, uint8_t sensorCount);
+};
+
+// Static member definitions
+TemperatureHistory::SensorHistory TemperatureHistory::history[TEMPERATURE_MAX_SENSORS];
+
+// Private methods
+void TemperatureHistory::onTemperatureEvent(const Event &event)
+{
+    add(event.sensor, event.temperature);
+}
+
+void TemperatureHistory::closeBucket(SensorHistory &sensor)
+{
+    Bucket &bucket = sensor.buckets[sensor.bucketNext];
+    bucket.count = sensor.count;
+    bucket.min = sensor.min;
+    bucket.max = sensor.max;
+    bucket.avg = 0;
+    if (sensor.count > 0)
+    {
+        // Rounded to the nearest raw step
+        int32_t half = sensor.count / 2;
+        bucket.avg = (TemperatureRaw)(sensor.sum >= 0 ? (sensor.sum + half) / sensor.count : -((-sensor.sum + half) / sensor.count));
+    }
+
+    sensor.bucketNext = (sensor.bucketNext + 1) % TEMPERATURE_HISTORY_BUCKETS;
+    if (sensor.bucketCount < TEMPERATURE_HISTORY_BUCKETS)
+    {
+        sensor.bucketCount++;
+    }
+
+    sensor.count = 0;
+    sensor.sum = 0;
+}
+
+// Public methods
+void TemperatureHistory::begin()
+{
+    for (uint8_t i = 0; i < TEMPERATURE_MAX_SENSORS; i++)
+    {
+        history[i].bucketStart = millis();
+    }
+
+    EventBus::subscribe(EventType::TEMPERATURE, onTemperatureEvent);
+}
+
+void TemperatureHistory::add(uint8_t sensor, TemperatureRaw temperature)
+{
+    if (sensor >= TEMPERATURE_MAX_SENSORS)
+    {
+        return;
+    }
+
+    SensorHistory &entry = history[sensor];
+    unsigned long now = millis();
+
+    // Close every period that ended since the last reading, at most a full ring of them
+    uint16_t closed = 0;
+    while (now - entry.bucketStart >= TEMPERATURE_HISTORY_BUCKET_PERIOD)
+    {
+        if (closed++ < TEMPERATURE_HISTORY_BUCKETS)
+        {
+            closeBucket(entry);
+        }
+        entry.bucketStart += TEMPERATURE_HISTORY_BUCKET_PERIOD;
+    }
+
+    // A disconnected sensor leaves a gap rather than a bogus reading
+    if (temperature == TEMPERATURE_RAW_DISCONNECTED)
+    {
+        return;
+    }
+
+    entry.fine[entry.fineNext] = temperature;
+    entry.fineNext = (entry.fineNext + 1) % TEMPERATURE_HISTORY_FINE_SIZE;
+    if (entry.fineCount < TEMPERATURE_HISTORY_FINE_SIZE)
+    {
+        entry.fineCount++;
+    }
+    entry.lastSampleTime = now;
+
+    if (entry.count == 0 || temperature < entry.min)
+    {
+        entry.min = temperature;
+    }
+    if (entry.count == 0 || temperature > entry.max)
+    {
+        entry.max = temperature;
+    }
+    entry.sum += temperature;
+    entry.count++;
+}
+
+// One JSON object for every sensor, oldest values first. Ages are ms before
+// now of the newest fine reading and of the end of the newest bucket.
+// Returns 0 if it does not fit in the buffer.
+size_t TemperatureHistory::formatJson(char *buffer, size_t size, uint8_t sensorCount)
+{
+    unsigned long now = millis();
+    size_t length = snprintf(buffer, size, "{\"fineMs\":%u,\"bucketMs\":%u,\"sensors\":[",
+                             (unsigned int)TEMPERATURE_READ_INTERVAL,
+                             (unsigned int)TEMPERATURE_HISTORY_BUCKET_PERIOD);
+
+    for (uint8_t i = 0; i < sensorCount && i < TEMPERATURE_MAX_SENSORS && length < size; i++)
+    {
+        const SensorHistory &entry = history[i];
+
+        length += snprintf(buffer + length, size - length, "%s{\"sensor\":%u,\"fineAge\":%lu,\"fine\":[",
+                           i == 0 ? "" : ",", (unsigned int)i, entry.fineCount > 0 ? now - entry.lastSampleTime : 0UL);
+
+        for (uint8_t j = 0; j < entry.fineCount && length < size; j++)
+        {
+            uint8_t index = (entry.fineNext + TEMPERATURE_HISTORY_FINE_SIZE - entry.fineCount + j) % TEMPERATURE_HISTORY_FINE_SIZE;
+            char temperature[12];
+            TemperatureFormat::formatF(entry.fine[index], 1, temperature, sizeof(temperature));
+            length += snprintf(buffer + length, size - length, "%s%s", j == 0 ? "" : ",", temperature);
+        }
+
+        if (length < size)
+        {
+            length += snprintf(buffer + length, size - length, "],\"bucketAge\":%lu,\"buckets\":[", now - entry.bucketStart);
+        }
+
+        for (uint8_t j = 0; j < entry.bucketCount && length < size; j++)
+        {
+            const Bucket &bucket = entry.buckets[(entry.bucketNext + TEMPERATURE_HISTORY_BUCKETS - entry.bucketCount + j) % TEMPERATURE_HISTORY_BUCKETS];
+            if (bucket.count == 0)
+            {
+                length += snprintf(buffer + length, size - length, "%snull", j == 0 ? "" : ",");
+            }
+            else
+            {
+                char minimum[12];
+                char average[12];
+                char maximum[12];
+                TemperatureFormat::formatF(bucket.min, 1, minimum, sizeof(minimum));
+                TemperatureFormat::formatF(bucket.avg, 1, average, sizeof(average));
+                TemperatureFormat::formatF(bucket.max, 1, maximum, sizeof(maximum));
+                length += snprintf(buffer + length, size - length, "%s[%s,%s,%s]", j == 0 ? "" : ",", minimum, average, maximum);
+            }
+        }
+
+        if (length < size)
+        {
+            length += snprintf(buffer + length, size - length, "]}");
+        }
+    }
+
+    if (length < size)
+    {
+        length += snprintf(buffer + length, size - length, "]}");
+    }
+
+    return length < size ? length : 0;
+}
@@ -0,0 +1,368 @@
+#pragma once
+#include "shared.h"
+#include "event_bus.h"
+#include "motor_control.h"
+#include "temperature_control.h"
+#include "binary_log.h"
+#include "temperature_format.h"
+#include <errno.h>
+
+enum class ThermostatMode : uint8_t
+{
+    OFF = 0,
+    ON = 1,
+    OVERRIDE = 2 // On, but paused after a manual or server command
+};
+
+// Opens and closes the window on the readings of THERMOSTAT_SENSOR without a
+// round trip to the server. Setpoints are kept as configured, in hundredths of
+// F, and compared in raw 1/16 C like the readings, so they act on the nearest
+// step of about 0.11 F.
+// There are three levels, closed, partially open and fully open. The window
+// opens to partialPercent at open and closes again at close, the gap between
+// the two is the hysteresis. If the fully open level is on it opens fully at
+// fullOpen and drops back to partialPercent at fullOpen - (open - close).
+// The window is not moved again by the thermostat within dwellMs of its last
+// move.
+class Thermostat
+{
+private:
+    struct Config
+    {
+        bool enabled;
+        bool fullOpenEnabled;
+        int32_t openHundredthsF;
+        int32_t closeHundredthsF;
+        int32_t fullOpenHundredthsF;
+        uint8_t partialPercent;
+        uint32_t dwellMs;
+    };
+
+    static Config config;
+    static TemperatureRaw open; // Setpoints of config in raw, set by applyConfig()
+    static TemperatureRaw close;
+    static TemperatureRaw fullOpen;
+    static bool overridden;
+    static unsigned long overrideStart;
+    static unsigned long lastMove;
+    static bool hasMoved;
+
+    static void onTemperatureEvent(const Event &event);
+    static int getTargetPercent(TemperatureRaw temperature, int positionPercent); // -1 to leave the window where it is
+    static void applyConfig();
+    static void saveConfig();
+    static bool parseNumber(const char *&text, unsigned long max, unsigned long &value); // One space, then digits up to max
+    static bool isSetpointInRange(int32_t hundredthsF);
+
+public:
+    static void begin();
+    static void override();                     // A manual or server command pauses the thermostat
+    static bool handleCommand(const char *command); // ON, OFF, RESUME or SET <open> <close> <full or OFF> <percent> <dwell s>, in F
+    static ThermostatMode getMode();
+    static void printStatus();
+    static String getModeString(ThermostatMode mode);
+};
+
+// Static member definitions
+Thermostat::Config Thermostat::config = {
+    false,
+    THERMOSTAT_DEFAULT_FULL_OPEN,
+    TEMPERATURE_HUNDREDTHS_FROM_F(THERMOSTAT_DEFAULT_OPEN_F),
+    TEMPERATURE_HUNDREDTHS_FROM_F(THERMOSTAT_DEFAULT_CLOSE_F),
+    TEMPERATURE_HUNDREDTHS_FROM_F(THERMOSTAT_DEFAULT_FULL_OPEN_F),
+    THERMOSTAT_DEFAULT_PARTIAL_PERCENT,
+    THERMOSTAT_DEFAULT_DWELL};
+TemperatureRaw Thermostat::open = 0;
+TemperatureRaw Thermostat::close = 0;
+TemperatureRaw Thermostat::fullOpen = 0;
+bool Thermostat::overridden = false;
+unsigned long Thermostat::overrideStart = 0U;
+unsigned long Thermostat::lastMove = 0U;
+bool Thermostat::hasMoved = false;
+
+// Private methods
+void Thermostat::onTemperatureEvent(const Event &event)
+{
+    if (event.sensor != THERMOSTAT_SENSOR || getMode() != ThermostatMode::ON)
+    {
+        return;
+    }
+
+    if (event.temperature == TEMPERATURE_RAW_DISCONNECTED || MotorControl::isMotorMoving())
+    {
+        return;
+    }
+
+    if (hasMoved && millis() - lastMove < config.dwellMs)
+    {
+        return;
+    }
+
+    int position = MotorControl::getPositionPercent();
+    int target = getTargetPercent(event.temperature, position);
+    if (target == position || target < 0)
+    {
+        return;
+    }
+
+    char temperature[12];
+    TemperatureFormat::formatF(event.temperature, 2, temperature, sizeof(temperature));
+    LOG_EVENT("Thermostat: %s F, moving from %d%% to %d%%.\n", temperature, position, target);
+
+    // Fully open and closed run into the endstops
+    if (target == 0)
+    {
+        MotorControl::setRequestedMotorState(MotorState::CLOSING);
+    }
+    else if (target == 100)
+    {
+        MotorControl::setRequestedMotorState(MotorState::OPENING);
+    }
+    else
+    {
+        MotorControl::setRequestedPosition(target);
+    }
+
+    lastMove = millis();
+    hasMoved = true;
+}
+
+int Thermostat::getTargetPercent(TemperatureRaw temperature, int positionPercent)
+{
+    TemperatureRaw hysteresis = open - close;
+    bool fullOpenEnabled = config.fullOpenEnabled && config.partialPercent < 100;
+
+    // Without a known position only the endstops can be targeted
+    if (positionPercent < 0)
+    {
+        if (temperature <= close)
+        {
+            return 0;
+        }
+        if (temperature >= (fullOpenEnabled ? fullOpen : open))
+        {
+            return 100;
+        }
+        return -1;
+    }
+
+    // Level the window is at now, any other opening counts as partially open
+    if (positionPercent == 0)
+    {
+        return temperature >= open ? (fullOpenEnabled && temperature >= fullOpen ? 100 : config.partialPercent) : 0;
+    }
+
+    if (temperature <= close)
+    {
+        return 0;
+    }
+
+    if (fullOpenEnabled)
+    {
+        if (temperature >= fullOpen)
+        {
+            return 100;
+        }
+        if (positionPercent == 100 && temperature <= fullOpen - hysteresis)
+        {
+            return config.partialPercent;
+        }
+    }
+
+    // Inside the hysteresis band the window stays where it is
+    return positionPercent;
+}
+
+void Thermostat::applyConfig()
+{
+    open = TemperatureFormat::fromHundredthsF(config.openHundredthsF);
+    close = TemperatureFormat::fromHundredthsF(config.closeHundredthsF);
+    fullOpen = TemperatureFormat::fromHundredthsF(config.fullOpenHundredthsF);
+}
+
+void Thermostat::saveConfig()
+{
+    preferences.begin(THERMOSTAT_PREFERENCES_NAMESPACE, false);
+    preferences.putBytes("config", &config, sizeof(Config));
+    preferences.end();
+}
+
+bool Thermostat::parseNumber(const char *&text, unsigned long max, unsigned long &value)
+{
+    // strtoul() would also take signs and leading spaces, "-1" reads as ULONG_MAX
+    if (text[0] != ' ' || text[1] < '0' || text[1] > '9')
+    {
+        return false;
+    }
+
+    char *end;
+    errno = 0;
+    value = strtoul(text + 1, &end, 10);
+    if (errno != 0 || value > max)
+    {
+        return false;
+    }
+
+    text = end;
+    return true;
+}
+
+bool Thermostat::isSetpointInRange(int32_t hundredthsF)
+{
+    // What a DS18B20 can read, -55 to 125 C
+    return hundredthsF >= -6700 && hundredthsF <= 25700;
+}
+
+// Public methods
+void Thermostat::begin()
+{
+    preferences.begin(THERMOSTAT_PREFERENCES_NAMESPACE, true);
+    if (preferences.getBytesLength("config") == sizeof(Config))
+    {
+        preferences.getBytes("config", &config, sizeof(Config));
+    }
+    preferences.end();
+    applyConfig();
+
+    EventBus::subscribe(EventType::TEMPERATURE, onTemperatureEvent);
+    printStatus();
+}
+
+void Thermostat::override()
+{
+    if (config.enabled)
+    {
+        overridden = true;
+        overrideStart = millis();
+    }
+}
+
+bool Thermostat::handleCommand(const char *command)
+{
+    if (strcmp(command, "ON") == 0 || strcmp(command, "OFF") == 0)
+    {
+        config.enabled = command[1] == 'N';
+        overridden = false;
+    }
+    else if (strcmp(command, "RESUME") == 0)
+    {
+        overridden = false;
+    }
+    else if (strncmp(command, "SET ", 4) != 0)
+    {
+        LOG_EVENT("Invalid thermostat command: %s\n", command);
+        return false;
+    }
+    else
+    {
+        Config updated = config;
+        unsigned long percent = 0;
+        unsigned long dwellSeconds = 0;
+        const char *cursor = command + 4;
+
+        bool valid = TemperatureFormat::parseHundredthsF(cursor, updated.openHundredthsF) &&
+                     TemperatureFormat::parseHundredthsF(cursor, updated.closeHundredthsF);
+
+        // OFF instead of a fully open setpoint turns that level off
+        while (valid && *cursor == ' ')
+        {
+            cursor++;
+        }
+        updated.fullOpenEnabled = !(valid && strncmp(cursor, "OFF", 3) == 0);
+        if (!updated.fullOpenEnabled)
+        {
+            cursor += 3;
+        }
+        else
+        {
+            valid = valid && TemperatureFormat::parseHundredthsF(cursor, updated.fullOpenHundredthsF);
+        }
+
+        // Nothing may follow the dwell time
+        valid = valid &&
+                parseNumber(cursor, 100, percent) &&
+                parseNumber(cursor, THERMOSTAT_MAX_DWELL, dwellSeconds) &&
+                *cursor == '\0' &&
+                isSetpointInRange(updated.openHundredthsF) &&
+                isSetpointInRange(updated.closeHundredthsF) &&
+                (!updated.fullOpenEnabled || isSetpointInRange(updated.fullOpenHundredthsF));
+
+        // Checked on the raw steps the setpoints act on
+        TemperatureRaw updatedOpen = TemperatureFormat::fromHundredthsF(updated.openHundredthsF);
+        TemperatureRaw updatedClose = TemperatureFormat::fromHundredthsF(updated.closeHundredthsF);
+        TemperatureRaw updatedFullOpen = TemperatureFormat::fromHundredthsF(updated.fullOpenHundredthsF);
+
+        if (!valid || updatedClose >= updatedOpen || percent < 1 || (updated.fullOpenEnabled && updatedFullOpen <= updatedOpen))
+        {
+            LOG_EVENT("Invalid thermostat command: %s\n", command);
+            return false;
+        }
+
+        updated.partialPercent = percent;
+        updated.dwellMs = dwellSeconds * 1000UL;
+        config = updated;
+        applyConfig();
+    }
+
+    saveConfig();
+    printStatus();
+    return true;
+}
+
+ThermostatMode Thermostat::getMode()
+{
+    if (!config.enabled)
+    {
+        return ThermostatMode::OFF;
+    }
+
+    if (overridden && THERMOSTAT_OVERRIDE_TIME > 0 && millis() - overrideStart >= THERMOSTAT_OVERRIDE_TIME)
+    {
+        LOG_EVENT("Thermostat override ran out, resuming.\n");
+        overridden = false;
+    }
+
+    return overridden ? ThermostatMode::OVERRIDE : ThermostatMode::ON;
+}
+
+void Thermostat::printStatus()
+{
+    char openText[12];
+    char closeText[12];
+    char fullOpenText[12];
+    // As configured, the thermostat acts on the nearest raw step
+    TemperatureFormat::formatHundredthsF(config.openHundredthsF, openText, sizeof(openText));
+    TemperatureFormat::formatHundredthsF(config.closeHundredthsF, closeText, sizeof(closeText));
+    TemperatureFormat::formatHundredthsF(config.fullOpenHundredthsF, fullOpenText, sizeof(fullOpenText));
+
+    LOG.printf("Thermostat %s: open %s F, close %s F, fully open %s%s, partial %u%%, dwell %lu s\n",
+               getModeString(getMode()).c_str(),
+               openText,
+               closeText,
+               config.fullOpenEnabled ? fullOpenText : "off",
+               config.fullOpenEnabled ? " F" : "",
+               (unsigned int)config.partialPercent,
+               (unsigned long)(config.dwellMs / 1000UL));
+}
+
+String Thermostat::getModeString(ThermostatMode mode)
+{
+    switch (mode)
+    {
+    case ThermostatMode::OFF:
+        return String("OFF");
+        break;
+
+    case ThermostatMode::ON:
+        return String("ON");
+        break;
+
+    case ThermostatMode::OVERRIDE:
+        return String("OVERRIDE");
+        break;
+
+    default:
+        return String("UNKNOWN");
+        break;
+    }
+}
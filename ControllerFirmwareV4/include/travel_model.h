@@ -0,0 +1,186 @@
+#pragma once
+#include "shared.h"
+#include "motion_profile.h"
+#include <atomic>
+
+// Running statistics of full endstop to endstop moves in one direction.
+// The time is also kept relative to what the motion profile predicts for the
+// steps taken, so it can be applied to moves of any length.
+struct TravelStats
+{
+    uint32_t count;
+    float meanSteps;
+    float varianceSteps;
+    float meanMillis;
+    float varianceMillis;
+    float meanTimeRatio;
+    float varianceTimeRatio;
+};
+
+// Learns how many steps and how long a full move takes in each direction and
+// turns that into per move limits, so a jammed window is caught shortly after
+// the move should have finished instead of after MOTOR_RUN_TIMEOUT.
+class TravelModel
+{
+private:
+    static TravelStats closingStats;
+    static TravelStats openingStats;
+    static std::atomic<bool> statsChanged;
+
+    static void addSample(float &mean, float &variance, float weight, float sample);
+    static TravelStats &getStats(bool closing);
+    static unsigned long estimateMillis(uint32_t distance, uint32_t steps);
+
+public:
+    static void begin();
+    static void saveIfChanged(); // Call only while the motor is idle
+
+    static void record(bool closing, uint32_t distance, uint32_t steps, unsigned long durationMillis); // Moves planned to the endstop only
+    static void reset();
+    static bool isTrained(bool closing);
+    static unsigned long getTimeLimit(bool closing, uint32_t distance = MotionProfile::UNBOUNDED_MOVE, uint32_t expectedSteps = TRAVEL_MODEL_FULL_MOVE);
+    static uint32_t getStepLimit(bool closing, uint32_t expectedSteps = TRAVEL_MODEL_FULL_MOVE);
+    static void printStats();
+};
+
+// Static member definitions
+TravelStats TravelModel::closingStats = {0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+TravelStats TravelModel::openingStats = {0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+std::atomic<bool> TravelModel::statsChanged(false);
+
+// Private methods
+void TravelModel::addSample(float &mean, float &variance, float weight, float sample)
+{
+    // Incremental mean and variance. With weight = 1/n this is exact, once the
+    // weight bottoms out at 1/TRAVEL_MODEL_MAX_SAMPLES older moves fade out.
+    float delta = sample - mean;
+    mean += weight * delta;
+    variance = (1.0f - weight) * (variance + weight * delta * delta);
+}
+
+TravelStats &TravelModel::getStats(bool closing)
+{
+    return closing ? closingStats : openingStats;
+}
+
+unsigned long TravelModel::estimateMillis(uint32_t distance, uint32_t steps)
+{
+    // Ramp and cruise over the planned distance, anything past it creeps at the start speed
+    uint32_t creepSteps = steps > distance ? steps - distance : 0;
+    return MotionProfile::estimateMillis(MOTOR_SPEED, distance, creepSteps);
+}
+
+// Public methods
+void TravelModel::begin()
+{
+    preferences.begin(TRAVEL_MODEL_PREFERENCES_NAMESPACE, true);
+    if (preferences.getBytesLength("closing") == sizeof(TravelStats) && preferences.getBytesLength("opening") == sizeof(TravelStats))
+    {
+        preferences.getBytes("closing", &closingStats, sizeof(TravelStats));
+        preferences.getBytes("opening", &openingStats, sizeof(TravelStats));
+    }
+    preferences.end();
+
+    printStats();
+}
+
+void TravelModel::saveIfChanged()
+{
+    // Written by the motion task at the end of a move, saved from the loop task once it is idle
+    if (statsChanged)
+    {
+        statsChanged = false;
+
+        preferences.begin(TRAVEL_MODEL_PREFERENCES_NAMESPACE, false);
+        preferences.putBytes("closing", &closingStats, sizeof(TravelStats));
+        preferences.putBytes("opening", &openingStats, sizeof(TravelStats));
+        preferences.end();
+    }
+}
+
+void TravelModel::record(bool closing, uint32_t distance, uint32_t steps, unsigned long durationMillis)
+{
+    TravelStats &stats = getStats(closing);
+    unsigned long estimate = estimateMillis(distance, steps);
+    if (estimate == 0)
+    {
+        return;
+    }
+
+    if (stats.count < TRAVEL_MODEL_MAX_SAMPLES)
+    {
+        stats.count++;
+    }
+
+    float weight = 1.0f / stats.count;
+    addSample(stats.meanSteps, stats.varianceSteps, weight, steps);
+    addSample(stats.meanMillis, stats.varianceMillis, weight, durationMillis);
+    addSample(stats.meanTimeRatio, stats.varianceTimeRatio, weight, (float)durationMillis / estimate);
+
+    statsChanged = true;
+}
+
+void TravelModel::reset()
+{
+    closingStats = {0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    openingStats = {0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    statsChanged = true;
+}
+
+bool TravelModel::isTrained(bool closing)
+{
+    return getStats(closing).count >= TRAVEL_MODEL_MIN_SAMPLES;
+}
+
+unsigned long TravelModel::getTimeLimit(bool closing, uint32_t distance, uint32_t expectedSteps)
+{
+    if (!isTrained(closing))
+    {
+        return MOTOR_RUN_TIMEOUT;
+    }
+
+    TravelStats &stats = getStats(closing);
+    unsigned long limit;
+
+    if (distance == MotionProfile::UNBOUNDED_MOVE)
+    {
+        // Nothing to plan with, allow for a full move
+        limit = (unsigned long)(stats.meanMillis + TRAVEL_MODEL_DEVIATIONS * sqrtf(stats.varianceMillis)) + TRAVEL_MODEL_TIME_MARGIN;
+    }
+    else
+    {
+        // Steps past the expected endstop position all creep at the start speed
+        uint32_t steps = expectedSteps == TRAVEL_MODEL_FULL_MOVE ? distance : expectedSteps;
+        if (steps > distance)
+        {
+            steps += (uint32_t)(TRAVEL_MODEL_DEVIATIONS * sqrtf(stats.varianceSteps));
+        }
+        float ratio = stats.meanTimeRatio + TRAVEL_MODEL_DEVIATIONS * sqrtf(stats.varianceTimeRatio);
+        limit = (unsigned long)(ratio * estimateMillis(distance, steps)) + TRAVEL_MODEL_TIME_MARGIN;
+    }
+
+    return min(limit, (unsigned long)MOTOR_RUN_TIMEOUT);
+}
+
+uint32_t TravelModel::getStepLimit(bool closing, uint32_t expectedSteps)
+{
+    if (!isTrained(closing))
+    {
+        return UINT32_MAX;
+    }
+
+    TravelStats &stats = getStats(closing);
+
+    if (expectedSteps == TRAVEL_MODEL_FULL_MOVE)
+    {
+        expectedSteps = (uint32_t)stats.meanSteps;
+    }
+
+    return expectedSteps + (uint32_t)(TRAVEL_MODEL_DEVIATIONS * sqrtf(stats.varianceSteps)) + TRAVEL_MODEL_STEP_MARGIN;
+}
+
+void TravelModel::printStats()
+{
+    LOG.printf("Closing travel: %u moves, %.0f +/- %.0f steps, %.0f +/- %.0f ms, %.2f +/- %.2f x planned\n", (unsigned int)closingStats.count, closingStats.meanSteps, sqrtf(closingStats.varianceSteps), closingStats.meanMillis, sqrtf(closingStats.varianceMillis), closingStats.meanTimeRatio, sqrtf(closingStats.varianceTimeRatio));
+    LOG.printf("Opening travel: %u moves, %.0f +/- %.0f steps, %.0f +/- %.0f ms, %.2f +/- %.2f x planned\n", (unsigned int)openingStats.count, openingStats.meanSteps, sqrtf(openingStats.varianceSteps), openingStats.meanMillis, sqrtf(openingStats.varianceMillis), openingStats.meanTimeRatio, sqrtf(openingStats.varianceTimeRatio));
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "shared.h"
 #include "motor_control.h"
+#include "binary_log.h"
 
 class Utilities
 {
@@ -24,7 +25,7 @@ unsigned long Utilities::restartDelay = 0U;
 // Public methods
 void Utilities::restartController(unsigned long delay)
 {
-    LOG.printf("Restart triggered, the controller is scheduled to restart in %F seconds.\n", (float)delay / 1000);
+    LOG_EVENT("Restart triggered, the controller is scheduled to restart in %F seconds.\n", (float)delay / 1000);
     restartTriggerTime = millis();
     restartDelay = delay;
     restartTriggered = true;
@@ -44,7 +45,7 @@ void Utilities::handle()
     {
         if (millis() - restartTriggerTime >= restartDelay)
         {
-            LOG.println("Restarting now!");
+            LOG_EVENT("Restarting now!\n");
             LOG.flush();
             ESP.restart();
         }
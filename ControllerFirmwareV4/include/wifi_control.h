@@ -32,7 +32,7 @@ void WiFiControl::begin()
     // Pull save data from EEPROM
     wifiManager.autoConnect(CLIENT_ID, AP_PASSWD);
 
-    LedControl::setStatusLedColor(StatusColors::WIFI_CONNECTED);
+    EventBus::publish(Event::connectivityChanged(Connectivity::WIFI_CONNECTED));
     LOG.println("WiFi Setup complete!");
 }
 
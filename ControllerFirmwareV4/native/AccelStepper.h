@@ -0,0 +1,76 @@
+#pragma once
+// Step/dir driver interface of AccelStepper, pulses go out through NativeGpio
+#include <Arduino.h>
+
+class AccelStepper
+{
+private:
+    uint8_t stepPin = 0xFF;
+    uint8_t dirPin = 0xFF;
+    float maxSpeed = 1.0f;
+    float currentSpeed = 0.0f;
+    unsigned long stepInterval = 0;
+    unsigned long lastStepTime = 0;
+    long position = 0;
+
+public:
+    enum MotorInterfaceType
+    {
+        DRIVER = 1
+    };
+
+    AccelStepper() {}
+
+    AccelStepper(uint8_t interface, uint8_t stepPin, uint8_t dirPin) : stepPin(stepPin), dirPin(dirPin)
+    {
+        pinMode(stepPin, OUTPUT);
+        pinMode(dirPin, OUTPUT);
+    }
+
+    void setMaxSpeed(float speed)
+    {
+        maxSpeed = fabsf(speed);
+    }
+
+    void setSpeed(float speed)
+    {
+        currentSpeed = constrain(speed, -maxSpeed, maxSpeed);
+        stepInterval = currentSpeed == 0.0f ? 0 : (unsigned long)fabsf(1000000.0f / currentSpeed);
+    }
+
+    float speed()
+    {
+        return currentSpeed;
+    }
+
+    bool runSpeed()
+    {
+        if (stepInterval == 0)
+        {
+            return false;
+        }
+
+        unsigned long now = micros();
+        if (now - lastStepTime < stepInterval)
+        {
+            return false;
+        }
+        lastStepTime = now;
+
+        position += currentSpeed > 0 ? 1 : -1;
+        digitalWrite(dirPin, currentSpeed > 0 ? HIGH : LOW);
+        digitalWrite(stepPin, HIGH);
+        digitalWrite(stepPin, LOW);
+        return true;
+    }
+
+    void stop()
+    {
+        setSpeed(0.0f);
+    }
+
+    long currentPosition()
+    {
+        return position;
+    }
+};
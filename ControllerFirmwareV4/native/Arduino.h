@@ -0,0 +1,134 @@
+#pragma once
+// Host build of the Arduino-ESP32 core API used by the firmware. Only
+// compiled for the native environment, where this directory is on the
+// include path in front of everything else. Time is the host clock, GPIO is
+// simulated by NativeGpio and the FreeRTOS calls map onto std::thread.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+using std::max;
+using std::min;
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// newlib has strlcpy(), glibc only since 2.38
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char *destination, const char *source, size_t size)
+{
+    size_t length = strlen(source);
+    if (size > 0)
+    {
+        size_t copied = length < size - 1 ? length : size - 1;
+        memcpy(destination, source, copied);
+        destination[copied] = '\0';
+    }
+    return length;
+}
+#endif
+
+// Arduino random(), a value in [0, howBig)
+inline long random(long howBig)
+{
+    return howBig > 0 ? rand() % howBig : 0;
+}
+
+inline long random(long howSmall, long howBig)
+{
+    return howSmall >= howBig ? howSmall : howSmall + random(howBig - howSmall);
+}
+
+inline bool isDigit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Time
+namespace NativeClock
+{
+    inline std::chrono::steady_clock::time_point start()
+    {
+        static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+        return bootTime;
+    }
+
+    inline uint64_t nanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start()).count();
+    }
+}
+
+inline unsigned long millis()
+{
+    return (unsigned long)(NativeClock::nanos() / 1000000ULL);
+}
+
+inline unsigned long micros()
+{
+    return (unsigned long)(NativeClock::nanos() / 1000ULL);
+}
+
+inline void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+inline uint32_t getCpuFrequencyMhz()
+{
+    // ESP.getCycleCount() counts nanoseconds on the host
+    return 1000;
+}
+
+#include "WString.h"
+#include "Print.h"
+#include "native_gpio.h"
+#include "native_rtos.h"
+#include "native_timer.h"
+#include "Esp.h"
+
+// Serial goes to stdout like the log
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long baud) {}
+
+    size_t write(uint8_t c) override
+    {
+        return fwrite(&c, 1, 1, stdout);
+    }
+};
+
+HardwareSerial Serial;
+
+void setup();
+void loop();
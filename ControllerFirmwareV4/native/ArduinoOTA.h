@@ -0,0 +1,33 @@
+#pragma once
+// OTA updates are not possible on the host, the callbacks are never called
+#include <Arduino.h>
+#include <functional>
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+typedef enum
+{
+    OTA_AUTH_ERROR,
+    OTA_BEGIN_ERROR,
+    OTA_CONNECT_ERROR,
+    OTA_RECEIVE_ERROR,
+    OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass
+{
+public:
+    ArduinoOTAClass &setPort(uint16_t port) { return *this; }
+    ArduinoOTAClass &setPassword(const char *password) { return *this; }
+    ArduinoOTAClass &setHostname(const char *hostname) { return *this; }
+    ArduinoOTAClass &onStart(std::function<void()> callback) { return *this; }
+    ArduinoOTAClass &onEnd(std::function<void()> callback) { return *this; }
+    ArduinoOTAClass &onProgress(std::function<void(unsigned int, unsigned int)> callback) { return *this; }
+    ArduinoOTAClass &onError(std::function<void(ota_error_t)> callback) { return *this; }
+    int getCommand() { return U_FLASH; }
+    void begin() {}
+    void handle() {}
+};
+
+ArduinoOTAClass ArduinoOTA;
@@ -0,0 +1,61 @@
+#pragma once
+// Bounce2 debouncer over NativeGpio
+#include <Arduino.h>
+
+class Bounce
+{
+private:
+    uint8_t pin = 0;
+    uint16_t intervalMillis = 10;
+    bool state = true;
+    bool unstableState = true;
+    bool changed = false;
+    unsigned long lastChange = 0;
+
+public:
+    void attach(int newPin, int mode)
+    {
+        pin = newPin;
+        pinMode(pin, mode);
+        state = unstableState = digitalRead(pin);
+    }
+
+    void interval(uint16_t newInterval)
+    {
+        intervalMillis = newInterval;
+    }
+
+    bool update()
+    {
+        changed = false;
+        bool level = digitalRead(pin);
+
+        if (level != unstableState)
+        {
+            unstableState = level;
+            lastChange = millis();
+        }
+        else if (level != state && millis() - lastChange >= intervalMillis)
+        {
+            state = level;
+            changed = true;
+        }
+
+        return changed;
+    }
+
+    bool read()
+    {
+        return state;
+    }
+
+    bool fell()
+    {
+        return changed && !state;
+    }
+
+    bool rose()
+    {
+        return changed && state;
+    }
+};
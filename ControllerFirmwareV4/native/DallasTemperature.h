@@ -0,0 +1,165 @@
+#pragma once
+// DS18B20 bus with simulated sensors. The simulation sets the temperatures
+// with NativeTemperatureBus::setTemperature(), conversions take the real
+// 94-750 ms depending on the resolution.
+#include <Arduino.h>
+#include <OneWire.h>
+
+#define DEVICE_DISCONNECTED_C -127
+#define DEVICE_DISCONNECTED_F -196.6
+#define DEVICE_DISCONNECTED_RAW -7040
+#define NATIVE_TEMPERATURE_MAX_DEVICES 8
+
+typedef uint8_t DeviceAddress[8];
+
+class NativeTemperatureBus
+{
+public:
+    static uint8_t deviceCount;
+    static float temperaturesC[NATIVE_TEMPERATURE_MAX_DEVICES];
+
+    static void setDeviceCount(uint8_t count)
+    {
+        deviceCount = min(count, (uint8_t)NATIVE_TEMPERATURE_MAX_DEVICES);
+    }
+
+    static void setTemperature(uint8_t index, float celsius)
+    {
+        if (index < NATIVE_TEMPERATURE_MAX_DEVICES)
+        {
+            temperaturesC[index] = celsius;
+        }
+    }
+};
+
+// NATIVE_TEMP_SENSORS sets how many sensors are on the bus, 1 by default
+uint8_t NativeTemperatureBus::deviceCount = getenv("NATIVE_TEMP_SENSORS") != NULL ? min((uint8_t)atoi(getenv("NATIVE_TEMP_SENSORS")), (uint8_t)NATIVE_TEMPERATURE_MAX_DEVICES) : 1;
+float NativeTemperatureBus::temperaturesC[NATIVE_TEMPERATURE_MAX_DEVICES] = {21.0f, 4.0f, 16.0f, 21.0f, 21.0f, 21.0f, 21.0f, 21.0f};
+
+class DallasTemperature
+{
+private:
+    uint8_t resolution = 12;
+    bool waitForConversion = true;
+    unsigned long conversionStart = 0;
+    float latchedC[NATIVE_TEMPERATURE_MAX_DEVICES] = {};
+
+    int indexOf(const uint8_t *address)
+    {
+        // Simulated addresses are 0x28 followed by the device index
+        return address[0] == 0x28 && address[1] < NativeTemperatureBus::deviceCount ? address[1] : -1;
+    }
+
+public:
+    DallasTemperature(OneWire *bus) {}
+
+    void begin() {}
+
+    uint8_t getDeviceCount()
+    {
+        return NativeTemperatureBus::deviceCount;
+    }
+
+    bool getAddress(uint8_t *address, uint8_t index)
+    {
+        if (index >= NativeTemperatureBus::deviceCount)
+        {
+            return false;
+        }
+        memset(address, 0, 8);
+        address[0] = 0x28;
+        address[1] = index;
+        return true;
+    }
+
+    void setResolution(uint8_t bits)
+    {
+        resolution = constrain(bits, (uint8_t)9, (uint8_t)12);
+    }
+
+    void setResolution(const uint8_t *address, uint8_t bits)
+    {
+        setResolution(bits);
+    }
+
+    uint8_t getResolution()
+    {
+        return resolution;
+    }
+
+    void setWaitForConversion(bool wait)
+    {
+        waitForConversion = wait;
+    }
+
+    bool getWaitForConversion()
+    {
+        return waitForConversion;
+    }
+
+    int16_t millisToWaitForConversion(uint8_t bits)
+    {
+        return 750 / (1 << (12 - bits));
+    }
+
+    void requestTemperatures()
+    {
+        conversionStart = millis();
+        for (uint8_t i = 0; i < NATIVE_TEMPERATURE_MAX_DEVICES; i++)
+        {
+            latchedC[i] = NativeTemperatureBus::temperaturesC[i];
+        }
+
+        if (waitForConversion)
+        {
+            delay(millisToWaitForConversion(resolution));
+        }
+    }
+
+    bool requestTemperaturesByAddress(const uint8_t *address)
+    {
+        requestTemperatures();
+        return indexOf(address) >= 0;
+    }
+
+    bool isConversionComplete()
+    {
+        return millis() - conversionStart >= (unsigned long)millisToWaitForConversion(resolution);
+    }
+
+    float getTempCByIndex(uint8_t index)
+    {
+        if (index >= NativeTemperatureBus::deviceCount)
+        {
+            return DEVICE_DISCONNECTED_C;
+        }
+        // Quantized to the resolution like the sensor does
+        float step = 0.0625f * (1 << (12 - resolution));
+        return roundf(latchedC[index] / step) * step;
+    }
+
+    float getTempFByIndex(uint8_t index)
+    {
+        float celsius = getTempCByIndex(index);
+        return celsius == DEVICE_DISCONNECTED_C ? DEVICE_DISCONNECTED_F : celsius * 1.8f + 32.0f;
+    }
+
+    float getTempC(const uint8_t *address)
+    {
+        int index = indexOf(address);
+        return index < 0 ? DEVICE_DISCONNECTED_C : getTempCByIndex(index);
+    }
+
+    float getTempF(const uint8_t *address)
+    {
+        int index = indexOf(address);
+        return index < 0 ? DEVICE_DISCONNECTED_F : getTempFByIndex(index);
+    }
+
+    int16_t getTemp(const uint8_t *address)
+    {
+        // Raw value in 1/128 C
+        float celsius = getTempC(address);
+        return celsius == DEVICE_DISCONNECTED_C ? DEVICE_DISCONNECTED_RAW : (int16_t)(celsius * 128.0f);
+    }
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+
+class EspClass
+{
+public:
+    void restart()
+    {
+        // Nothing to restart into on the host, end the run
+        fflush(stdout);
+        exit(0);
+    }
+
+    uint32_t getCycleCount()
+    {
+        // Nanoseconds, see getCpuFrequencyMhz()
+        return (uint32_t)NativeClock::nanos();
+    }
+
+    uint32_t getFreeHeap()
+    {
+        return 0;
+    }
+};
+
+EspClass ESP;
@@ -0,0 +1,65 @@
+#pragma once
+// Status LED, the color is kept so the simulation can check it
+#include <Arduino.h>
+
+enum EOrder
+{
+    RGB = 0012,
+    GRB = 0102
+};
+
+struct CRGB
+{
+    uint8_t r, g, b;
+
+    enum HTMLColorCode : uint32_t
+    {
+        Black = 0x000000,
+        Blue = 0x0000FF,
+        Brown = 0xA52A2A,
+        DarkGreen = 0x006400,
+        Green = 0x008000,
+        GreenYellow = 0xADFF2F,
+        IndianRed = 0xCD5C5C,
+        Orange = 0xFFA500,
+        Purple = 0x800080,
+        Turquoise = 0x40E0D0,
+        Yellow = 0xFFFF00
+    };
+
+    CRGB() : r(0), g(0), b(0) {}
+    CRGB(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {}
+    CRGB(HTMLColorCode code) : r((code >> 16) & 0xFF), g((code >> 8) & 0xFF), b(code & 0xFF) {}
+};
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER = GRB>
+class WS2812B
+{
+};
+
+class CFastLED
+{
+public:
+    CRGB *leds = nullptr;
+    int ledCount = 0;
+    uint8_t brightness = 255;
+
+    template <template <uint8_t, EOrder> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+    CFastLED &addLeds(CRGB *data, int count)
+    {
+        leds = data;
+        ledCount = count;
+        return *this;
+    }
+
+    void setBrightness(uint8_t scale)
+    {
+        brightness = scale;
+    }
+
+    void show()
+    {
+    }
+};
+
+CFastLED FastLED;
@@ -0,0 +1,10 @@
+#pragma once
+#include <Arduino.h>
+
+class OneWire
+{
+public:
+    uint8_t pin;
+
+    OneWire(uint8_t pin) : pin(pin) {}
+};
@@ -0,0 +1,74 @@
+#pragma once
+// NVS kept in memory for the length of the run
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences
+{
+private:
+    static std::map<std::string, std::vector<uint8_t>> &storage()
+    {
+        static std::map<std::string, std::vector<uint8_t>> values;
+        return values;
+    }
+
+    std::string space;
+
+    std::string keyOf(const char *key) const
+    {
+        return space + "/" + key;
+    }
+
+public:
+    bool begin(const char *name, bool readOnly = false)
+    {
+        space = name;
+        return true;
+    }
+
+    void end()
+    {
+    }
+
+    size_t putBytes(const char *key, const void *value, size_t length)
+    {
+        const uint8_t *bytes = (const uint8_t *)value;
+        storage()[keyOf(key)] = std::vector<uint8_t>(bytes, bytes + length);
+        return length;
+    }
+
+    size_t getBytesLength(const char *key)
+    {
+        auto found = storage().find(keyOf(key));
+        return found == storage().end() ? 0 : found->second.size();
+    }
+
+    size_t getBytes(const char *key, void *buffer, size_t length)
+    {
+        auto found = storage().find(keyOf(key));
+        if (found == storage().end() || found->second.size() > length)
+        {
+            return 0;
+        }
+        memcpy(buffer, found->second.data(), found->second.size());
+        return found->second.size();
+    }
+
+    size_t putInt(const char *key, int32_t value)
+    {
+        return putBytes(key, &value, sizeof(value));
+    }
+
+    int32_t getInt(const char *key, int32_t defaultValue = 0)
+    {
+        int32_t value = defaultValue;
+        return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+    }
+
+    bool remove(const char *key)
+    {
+        return storage().erase(keyOf(key)) > 0;
+    }
+};
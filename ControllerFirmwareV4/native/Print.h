@@ -0,0 +1,75 @@
+#pragma once
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "WString.h"
+
+// Arduino Print, everything ends up in write(uint8_t)
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t written = 0;
+        while (size-- > 0)
+        {
+            written += write(*buffer++);
+        }
+        return written;
+    }
+
+    size_t write(const char *text)
+    {
+        return write((const uint8_t *)text, strlen(text));
+    }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+
+        if (length < 0)
+        {
+            return 0;
+        }
+
+        if ((size_t)length < sizeof(buffer))
+        {
+            return write((const uint8_t *)buffer, length);
+        }
+
+        // Too long for the stack buffer, format again into the heap
+        std::string text(length + 1, '\0');
+        va_start(args, format);
+        vsnprintf(&text[0], text.size(), format, args);
+        va_end(args);
+        return write((const uint8_t *)text.c_str(), length);
+    }
+
+    size_t print(const char *text) { return write(text); }
+    size_t print(const String &text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int number) { return printf("%d", number); }
+    size_t print(unsigned int number) { return printf("%u", number); }
+    size_t print(long number) { return printf("%ld", number); }
+    size_t print(unsigned long number) { return printf("%lu", number); }
+    size_t print(double number, int decimals = 2) { return printf("%.*f", decimals, number); }
+
+    size_t println() { return write("\r\n"); }
+
+    template <typename T>
+    size_t println(T value)
+    {
+        size_t written = print(value);
+        return written + println();
+    }
+
+    virtual void flush() {}
+};
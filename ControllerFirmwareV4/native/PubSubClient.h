@@ -0,0 +1,154 @@
+#pragma once
+// MQTT client on top of the simulated WiFiClient, the broker always accepts
+// once the TCP connection is up. Publishes are echoed to stdout and incoming
+// messages can be fed in with inject().
+#include <Arduino.h>
+#include <WiFi.h>
+#include <functional>
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char *, uint8_t *, unsigned int)> callback
+
+class PubSubClient
+{
+private:
+    MQTT_CALLBACK_SIGNATURE;
+    WiFiClient *client = nullptr;
+    bool isConnected = false;
+    uint16_t bufferSize = 256;
+
+public:
+    uint32_t publishCount = 0;
+    bool echo = true; // Off for benchmarks
+
+    PubSubClient() {}
+    PubSubClient(WiFiClient &wifiClient) : client(&wifiClient) {}
+
+    PubSubClient &setServer(const char *domain, uint16_t port)
+    {
+        return *this;
+    }
+
+    PubSubClient &setServer(IPAddress ip, uint16_t port)
+    {
+        return *this;
+    }
+
+    PubSubClient &setSocketTimeout(uint16_t timeout)
+    {
+        return *this;
+    }
+
+    PubSubClient &setCallback(std::function<void(char *, uint8_t *, unsigned int)> newCallback)
+    {
+        callback = newCallback;
+        return *this;
+    }
+
+    bool setBufferSize(uint16_t size)
+    {
+        bufferSize = size;
+        return true;
+    }
+
+    uint16_t getBufferSize()
+    {
+        return bufferSize;
+    }
+
+    bool connect(const char *id, const char *user, const char *password)
+    {
+        // Like PubSubClient, an open client is used as is
+        if (client != nullptr && !client->connected() && !client->connect(IPAddress(127, 0, 0, 1), 1883, 1000))
+        {
+            return false;
+        }
+
+        isConnected = true;
+        return true;
+    }
+
+    bool connected()
+    {
+        return isConnected && (client == nullptr || client->connected());
+    }
+
+    void disconnect()
+    {
+        isConnected = false;
+        if (client != nullptr)
+        {
+            client->stop();
+        }
+    }
+
+    int state()
+    {
+        return isConnected ? 0 : -1;
+    }
+
+    bool publish(const char *topic, const char *payload)
+    {
+        return publish(topic, payload, false);
+    }
+
+    bool publish(const char *topic, const char *payload, bool retained)
+    {
+        if (!connected() || strlen(topic) + strlen(payload) + 7 > bufferSize)
+        {
+            return false;
+        }
+
+        publishCount++;
+        if (echo)
+        {
+            printf("MQTT> %s %s\n", topic, payload);
+        }
+        return true;
+    }
+
+    // Binary payloads that are not printable are echoed as hex
+    bool publish(const char *topic, const uint8_t *payload, unsigned int length)
+    {
+        if (!connected() || strlen(topic) + length + 7 > bufferSize)
+        {
+            return false;
+        }
+
+        bool printable = true;
+        for (unsigned int i = 0; i < length; i++)
+        {
+            printable = printable && payload[i] >= 0x20 && payload[i] < 0x7F;
+        }
+
+        publishCount++;
+        if (echo)
+        {
+            printf("MQTT> %s ", topic);
+            for (unsigned int i = 0; i < length; i++)
+            {
+                printf(printable ? "%c" : "%02X", payload[i]);
+            }
+            printf("\n");
+        }
+        return true;
+    }
+
+    bool subscribe(const char *topic)
+    {
+        return connected();
+    }
+
+    bool loop()
+    {
+        return connected();
+    }
+
+    // Deliver a message as if it came from the broker
+    void inject(const char *topic, const char *payload)
+    {
+        if (callback)
+        {
+            callback((char *)topic, (uint8_t *)payload, strlen(payload));
+        }
+    }
+};
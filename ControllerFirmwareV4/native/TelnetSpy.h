@@ -0,0 +1,67 @@
+#pragma once
+// The telnet log on stdout, commands are read from stdin
+#include <Arduino.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+class TelnetSpy : public Print
+{
+private:
+    int peeked = -1;
+
+    int readInput()
+    {
+        unsigned char c;
+        return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+    }
+
+public:
+    void setWelcomeMsg(char *message)
+    {
+        fputs(message, stdout);
+    }
+
+    void begin(unsigned long baud)
+    {
+        // Line buffered so the log keeps up when piped
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    }
+
+    void handle()
+    {
+    }
+
+    size_t write(uint8_t c) override
+    {
+        return fwrite(&c, 1, 1, stdout);
+    }
+
+    void flush() override
+    {
+        fflush(stdout);
+    }
+
+    int available()
+    {
+        if (peeked < 0)
+        {
+            peeked = readInput();
+        }
+        return peeked < 0 ? 0 : 1;
+    }
+
+    int peek()
+    {
+        available();
+        return peeked;
+    }
+
+    int read()
+    {
+        available();
+        int c = peeked;
+        peeked = -1;
+        return c;
+    }
+};
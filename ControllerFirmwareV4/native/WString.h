@@ -0,0 +1,103 @@
+#pragma once
+// Arduino String on top of std::string, with the members the firmware uses
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+class String
+{
+private:
+    std::string value;
+
+public:
+    String() {}
+    String(const char *text) : value(text != nullptr ? text : "") {}
+    String(const std::string &text) : value(text) {}
+    explicit String(char c) : value(1, c) {}
+    explicit String(int number) : value(std::to_string(number)) {}
+    explicit String(unsigned int number) : value(std::to_string(number)) {}
+    explicit String(long number) : value(std::to_string(number)) {}
+    explicit String(unsigned long number) : value(std::to_string(number)) {}
+    explicit String(long long number) : value(std::to_string(number)) {}
+    explicit String(unsigned long long number) : value(std::to_string(number)) {}
+    explicit String(float number, unsigned int decimals = 2) : String((double)number, decimals) {}
+    explicit String(double number, unsigned int decimals = 2)
+    {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+        value = buffer;
+    }
+
+    const char *c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+    char operator[](unsigned int index) const { return index < value.length() ? value[index] : 0; }
+
+    bool equals(const String &other) const { return value == other.value; }
+    bool operator==(const String &other) const { return value == other.value; }
+    bool operator==(const char *other) const { return value == other; }
+    bool operator!=(const String &other) const { return value != other.value; }
+    bool operator!=(const char *other) const { return value != other; }
+
+    bool startsWith(const String &prefix) const
+    {
+        return value.compare(0, prefix.value.length(), prefix.value) == 0;
+    }
+
+    bool endsWith(const String &suffix) const
+    {
+        return value.length() >= suffix.value.length() && value.compare(value.length() - suffix.value.length(), suffix.value.length(), suffix.value) == 0;
+    }
+
+    String substring(unsigned int from) const
+    {
+        return from < value.length() ? String(value.substr(from)) : String();
+    }
+
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+        {
+            std::swap(from, to);
+        }
+        return from < value.length() ? String(value.substr(from, to - from)) : String();
+    }
+
+    int indexOf(char c, unsigned int from = 0) const
+    {
+        size_t found = value.find(c, from);
+        return found == std::string::npos ? -1 : (int)found;
+    }
+
+    long toInt() const { return atol(value.c_str()); }
+    float toFloat() const { return (float)atof(value.c_str()); }
+
+    void trim()
+    {
+        size_t first = value.find_first_not_of(" \t\r\n");
+        size_t last = value.find_last_not_of(" \t\r\n");
+        value = first == std::string::npos ? std::string() : value.substr(first, last - first + 1);
+    }
+
+    String &operator+=(const String &other)
+    {
+        value += other.value;
+        return *this;
+    }
+
+    String &operator+=(const char *other)
+    {
+        value += other;
+        return *this;
+    }
+
+    String &operator+=(char c)
+    {
+        value += c;
+        return *this;
+    }
+
+    friend String operator+(const String &left, const String &right) { return String(left.value + right.value); }
+    friend String operator+(const String &left, const char *right) { return String(left.value + right); }
+    friend String operator+(const char *left, const String &right) { return String(left + right.value); }
+    friend String operator+(const String &left, char right) { return String(left.value + right); }
+};
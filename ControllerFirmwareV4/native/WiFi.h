@@ -0,0 +1,116 @@
+#pragma once
+// Always connected station. The broker can be made unreachable for the first
+// NATIVE_BROKER_DOWN_MS milliseconds of a run to exercise the reconnect path.
+#include <Arduino.h>
+#include <stdlib.h>
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+class IPAddress
+{
+private:
+    uint8_t octets[4] = {0, 0, 0, 0};
+
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+    IPAddress(uint32_t address)
+    {
+        memcpy(octets, &address, sizeof(octets));
+    }
+
+    operator uint32_t() const
+    {
+        uint32_t address;
+        memcpy(&address, octets, sizeof(address));
+        return address;
+    }
+
+    bool fromString(const char *address)
+    {
+        unsigned int a, b, c, d;
+        char trailing;
+        if (sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &trailing) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+        {
+            return false;
+        }
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+
+    uint8_t operator[](int index) const
+    {
+        return octets[index];
+    }
+
+    String toString() const
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+        return String(text);
+    }
+};
+
+class WiFiClass
+{
+public:
+    int status()
+    {
+        return WL_CONNECTED;
+    }
+
+    int RSSI()
+    {
+        return -50;
+    }
+
+    String softAPIP()
+    {
+        return String("192.168.4.1");
+    }
+
+    // Every name resolves to the loopback address
+    int hostByName(const char *host, IPAddress &address)
+    {
+        address = IPAddress(127, 0, 0, 1);
+        return 1;
+    }
+};
+
+WiFiClass WiFi;
+
+class WiFiClient
+{
+private:
+    bool isConnected = false;
+
+    static unsigned long brokerDownUntil()
+    {
+        static unsigned long until = getenv("NATIVE_BROKER_DOWN_MS") != NULL ? strtoul(getenv("NATIVE_BROKER_DOWN_MS"), NULL, 10) : 0;
+        return until;
+    }
+
+public:
+    int connect(IPAddress ip, uint16_t port, int32_t timeout)
+    {
+        if (millis() < brokerDownUntil())
+        {
+            // Refused right away, the device would wait out the timeout
+            return 0;
+        }
+
+        isConnected = true;
+        return 1;
+    }
+
+    uint8_t connected()
+    {
+        return isConnected;
+    }
+
+    void stop()
+    {
+        isConnected = false;
+    }
+};
@@ -0,0 +1,26 @@
+#pragma once
+// Connects right away, the config portal never opens
+#include <WiFi.h>
+#include <functional>
+
+class WiFiManager
+{
+private:
+    String portalSsid;
+
+public:
+    void setAPCallback(std::function<void(WiFiManager *)> callback) {}
+    void setSaveConfigCallback(std::function<void()> callback) {}
+    void setConfigPortalTimeout(unsigned long seconds) {}
+
+    bool autoConnect(const char *ssid, const char *password)
+    {
+        portalSsid = ssid;
+        return true;
+    }
+
+    String getConfigPortalSSID()
+    {
+        return portalSsid;
+    }
+};
@@ -0,0 +1,40 @@
+#pragma once
+// lwIP's asynchronous DNS lookup. Every name resolves to the loopback address
+// after NATIVE_DNS_DELAY_MS, answered from another thread like the tcpip task.
+#include <Arduino.h>
+#include <stdlib.h>
+#include <thread>
+
+typedef int8_t err_t;
+
+#define ERR_OK 0
+#define ERR_INPROGRESS -5
+#define ERR_ARG -16
+
+struct ip4_addr_t
+{
+    uint32_t addr;
+};
+
+struct ip_addr_t
+{
+    union
+    {
+        ip4_addr_t ip4;
+    } u_addr;
+};
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+
+inline err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg)
+{
+    static unsigned long delay = getenv("NATIVE_DNS_DELAY_MS") != NULL ? strtoul(getenv("NATIVE_DNS_DELAY_MS"), NULL, 10) : 20;
+
+    std::thread([hostname, found, callback_arg]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        ip_addr_t loopback;
+        loopback.u_addr.ip4.addr = 0x0100007FUL; // 127.0.0.1 in network order
+        found(hostname, &loopback, callback_arg);
+    }).detach();
+    return ERR_INPROGRESS;
+}
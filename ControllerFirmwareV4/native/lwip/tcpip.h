@@ -0,0 +1,12 @@
+#pragma once
+// Work handed to lwIP's tcpip task, run on a thread of its own
+#include <thread>
+#include "dns.h"
+
+typedef void (*tcpip_callback_fn)(void *ctx);
+
+inline err_t tcpip_callback(tcpip_callback_fn function, void *ctx)
+{
+    std::thread(function, ctx).detach();
+    return ERR_OK;
+}
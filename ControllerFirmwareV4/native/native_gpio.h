@@ -0,0 +1,123 @@
+#pragma once
+// Simulated GPIO. Outputs are latched, inputs are driven by the simulation
+// through NativeGpio::setInput(), which runs attached interrupt handlers on
+// the calling thread the way the pin ISR would run on the device.
+#include <atomic>
+
+#define NATIVE_GPIO_COUNT 40
+
+class NativeGpio
+{
+private:
+    static std::atomic<uint8_t> levels[NATIVE_GPIO_COUNT];
+    static uint8_t modes[NATIVE_GPIO_COUNT];
+    static bool driven[NATIVE_GPIO_COUNT]; // Input level comes from the simulation
+    static void (*handlers[NATIVE_GPIO_COUNT])();
+    static uint8_t handlerModes[NATIVE_GPIO_COUNT];
+    static void (*outputObserver)(uint8_t pin, uint8_t level);
+
+public:
+    static void setMode(uint8_t pin, uint8_t mode)
+    {
+        modes[pin] = mode;
+        if (mode == INPUT_PULLUP && !driven[pin])
+        {
+            levels[pin] = HIGH;
+        }
+    }
+
+    static void write(uint8_t pin, uint8_t level)
+    {
+        uint8_t previous = levels[pin].exchange(level ? HIGH : LOW);
+        if (outputObserver != nullptr && previous != (level ? HIGH : LOW))
+        {
+            outputObserver(pin, level ? HIGH : LOW);
+        }
+    }
+
+    static uint8_t read(uint8_t pin)
+    {
+        return levels[pin];
+    }
+
+    // Drive an input from the simulation
+    static void setInput(uint8_t pin, uint8_t level)
+    {
+        driven[pin] = true;
+        uint8_t previous = levels[pin].exchange(level ? HIGH : LOW);
+        if (previous == (level ? HIGH : LOW) || handlers[pin] == nullptr)
+        {
+            return;
+        }
+
+        bool rising = level != LOW;
+        if (handlerModes[pin] == CHANGE || (handlerModes[pin] == RISING && rising) || (handlerModes[pin] == FALLING && !rising))
+        {
+            handlers[pin]();
+        }
+    }
+
+    static void attachHandler(uint8_t pin, void (*handler)(), uint8_t mode)
+    {
+        handlers[pin] = handler;
+        handlerModes[pin] = mode;
+    }
+
+    static void detachHandler(uint8_t pin)
+    {
+        handlers[pin] = nullptr;
+    }
+
+    // Called for every output level change, the simulation uses it to watch the driver pins
+    static void setOutputObserver(void (*observer)(uint8_t pin, uint8_t level))
+    {
+        outputObserver = observer;
+    }
+
+    static uint32_t readAll()
+    {
+        uint32_t value = 0;
+        for (uint8_t pin = 0; pin < 32; pin++)
+        {
+            value |= (uint32_t)levels[pin] << pin;
+        }
+        return value;
+    }
+};
+
+std::atomic<uint8_t> NativeGpio::levels[NATIVE_GPIO_COUNT];
+uint8_t NativeGpio::modes[NATIVE_GPIO_COUNT];
+bool NativeGpio::driven[NATIVE_GPIO_COUNT];
+void (*NativeGpio::handlers[NATIVE_GPIO_COUNT])() = {};
+uint8_t NativeGpio::handlerModes[NATIVE_GPIO_COUNT];
+void (*NativeGpio::outputObserver)(uint8_t pin, uint8_t level) = nullptr;
+
+inline void pinMode(uint8_t pin, uint8_t mode)
+{
+    NativeGpio::setMode(pin, mode);
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level)
+{
+    NativeGpio::write(pin, level);
+}
+
+inline int digitalRead(uint8_t pin)
+{
+    return NativeGpio::read(pin);
+}
+
+inline uint8_t digitalPinToInterrupt(uint8_t pin)
+{
+    return pin;
+}
+
+inline void attachInterrupt(uint8_t pin, void (*handler)(), int mode)
+{
+    NativeGpio::attachHandler(pin, handler, mode);
+}
+
+inline void detachInterrupt(uint8_t pin)
+{
+    NativeGpio::detachHandler(pin);
+}
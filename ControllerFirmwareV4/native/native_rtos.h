@@ -0,0 +1,99 @@
+#pragma once
+// The FreeRTOS task calls the firmware uses, on top of std::thread. Priorities
+// and core affinity are ignored, every task is a host thread with 1 ms ticks.
+#include <condition_variable>
+#include <mutex>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+struct NativeTask
+{
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t notifyCount = 0;
+};
+
+typedef NativeTask *TaskHandle_t;
+
+// The task a thread runs as, so ulTaskNotifyTake() knows whose count to take
+inline NativeTask *&nativeCurrentTask()
+{
+    static thread_local NativeTask *task = nullptr;
+    return task;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*function)(void *), const char *name, uint32_t stackDepth, void *parameter, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    NativeTask *task = new NativeTask();
+    if (handle != nullptr)
+    {
+        *handle = task;
+    }
+
+    std::thread([function, parameter, task]() {
+        nativeCurrentTask() = task;
+        function(parameter);
+    }).detach();
+
+    return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(void (*function)(void *), const char *name, uint32_t stackDepth, void *parameter, UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameter, priority, handle, 0);
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+    NativeTask *task = nativeCurrentTask();
+    if (task == nullptr)
+    {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(task->mutex);
+    if (ticksToWait == portMAX_DELAY)
+    {
+        task->notified.wait(lock, [task]() { return task->notifyCount > 0; });
+    }
+    else
+    {
+        task->notified.wait_for(lock, std::chrono::milliseconds(ticksToWait), [task]() { return task->notifyCount > 0; });
+    }
+
+    uint32_t count = task->notifyCount;
+    if (count > 0)
+    {
+        task->notifyCount = clearOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifyCount++;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline void yield()
+{
+    std::this_thread::yield();
+}
@@ -0,0 +1,42 @@
+#pragma once
+// Hardware timer API. The native build only runs the polled step backend and
+// an unfiltered endstop path, so the timers never fire; they exist so every
+// module still compiles unchanged.
+struct hw_timer_t
+{
+    uint8_t num;
+    uint64_t alarm;
+    bool enabled;
+    void (*handler)();
+};
+
+inline hw_timer_t *timerBegin(uint8_t num, uint16_t divider, bool countUp)
+{
+    static hw_timer_t timers[4];
+    timers[num & 3] = {num, 0, false, nullptr};
+    return &timers[num & 3];
+}
+
+inline void timerAttachInterrupt(hw_timer_t *timer, void (*handler)(), bool edge)
+{
+    timer->handler = handler;
+}
+
+inline void timerAlarmWrite(hw_timer_t *timer, uint64_t alarm, bool autoreload)
+{
+    timer->alarm = alarm;
+}
+
+inline void timerAlarmEnable(hw_timer_t *timer)
+{
+    timer->enabled = true;
+}
+
+inline void timerAlarmDisable(hw_timer_t *timer)
+{
+    timer->enabled = false;
+}
+
+inline void timerWrite(hw_timer_t *timer, uint64_t value)
+{
+}
@@ -0,0 +1,93 @@
+#pragma once
+// Window and stepper driver model for the native build. It watches the
+// driver pins the firmware writes, moves the window by the microstep size the
+// MICRO pins select and drives the endstop inputs. Positions are in 1/16
+// steps so every microstep mode maps onto whole units.
+#include "shared.h"
+
+#define SIM_WINDOW_TRAVEL 24000    // 1/16 steps between the endstops
+#define SIM_WINDOW_OVERTRAVEL 800  // How far past an endstop the window can be pushed
+#define SIM_WINDOW_START 12000     // Where the window is at power on
+
+class SimWindow
+{
+private:
+    static std::atomic<int32_t> position;
+    static std::atomic<uint32_t> stepCount;
+    static std::atomic<uint32_t> lostSteps; // Pulses into the mechanical stop
+
+    static uint8_t getStepSize()
+    {
+        // A4988 MS1..MS3 table
+        uint8_t levels = digitalRead(MICRO_PIN_1) | (digitalRead(MICRO_PIN_2) << 1) | (digitalRead(MICRO_PIN_3) << 2);
+        switch (levels)
+        {
+        case 0b000:
+            return 16;
+        case 0b001:
+            return 8;
+        case 0b010:
+            return 4;
+        case 0b111:
+            return 1;
+        default:
+            return 2;
+        }
+    }
+
+    static void updateEndstops()
+    {
+        int32_t current = position;
+        NativeGpio::setInput(CLOSE_ENDSTOP_PIN, current <= 0 ? LOW : HIGH);
+        NativeGpio::setInput(OPEN_ENDSTOP_PIN, current >= SIM_WINDOW_TRAVEL ? LOW : HIGH);
+    }
+
+    static void onOutputChange(uint8_t pin, uint8_t level)
+    {
+        // The driver steps on the rising edge while enabled (ENABLE is active low)
+        if (pin != STEP_PIN || level != HIGH || digitalRead(ENABLE_PIN) != LOW)
+        {
+            return;
+        }
+
+        stepCount++;
+
+        // DIR high closes the window
+        int32_t next = position + (digitalRead(DIR_PIN) == HIGH ? -getStepSize() : getStepSize());
+        if (next < -SIM_WINDOW_OVERTRAVEL || next > SIM_WINDOW_TRAVEL + SIM_WINDOW_OVERTRAVEL)
+        {
+            lostSteps++;
+            return;
+        }
+
+        position = next;
+        updateEndstops();
+    }
+
+public:
+    static void begin(int32_t startPosition = SIM_WINDOW_START)
+    {
+        position = startPosition;
+        NativeGpio::setOutputObserver(onOutputChange);
+        updateEndstops();
+    }
+
+    static int32_t getPosition()
+    {
+        return position;
+    }
+
+    static uint32_t getStepCount()
+    {
+        return stepCount;
+    }
+
+    static uint32_t getLostSteps()
+    {
+        return lostSteps;
+    }
+};
+
+std::atomic<int32_t> SimWindow::position(SIM_WINDOW_START);
+std::atomic<uint32_t> SimWindow::stepCount(0);
+std::atomic<uint32_t> SimWindow::lostSteps(0);
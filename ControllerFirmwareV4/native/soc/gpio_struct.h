@@ -0,0 +1,50 @@
+#pragma once
+// GPIO register block for pins 0-31, backed by NativeGpio
+#include <Arduino.h>
+
+struct NativeGpioSetRegister
+{
+    NativeGpioSetRegister &operator=(uint32_t mask)
+    {
+        for (uint8_t pin = 0; pin < 32; pin++)
+        {
+            if (mask & (1UL << pin))
+            {
+                NativeGpio::write(pin, HIGH);
+            }
+        }
+        return *this;
+    }
+};
+
+struct NativeGpioClearRegister
+{
+    NativeGpioClearRegister &operator=(uint32_t mask)
+    {
+        for (uint8_t pin = 0; pin < 32; pin++)
+        {
+            if (mask & (1UL << pin))
+            {
+                NativeGpio::write(pin, LOW);
+            }
+        }
+        return *this;
+    }
+};
+
+struct NativeGpioInRegister
+{
+    operator uint32_t() const
+    {
+        return NativeGpio::readAll();
+    }
+};
+
+struct NativeGpioRegisters
+{
+    NativeGpioSetRegister out_w1ts;
+    NativeGpioClearRegister out_w1tc;
+    NativeGpioInRegister in;
+};
+
+NativeGpioRegisters GPIO;
@@ -7,6 +7,8 @@
 // Temp feature
 #ifdef ENABLE_TEMP_FEATURE
 #include "temperature_control.h"
+#include "temperature_history.h"
+#include "thermostat.h"
 #endif
 
 #include "wifi_control.h"
@@ -15,59 +17,50 @@
 #include "ota_control.h"
 #include "remote_control.h"
 #include "mqtt_control.h"
+#include "loop_profiler.h"
+#include "scheduler.h"
 
-void setup()
+// Reads a number typed right after a telnet command key, e.g. "O35".
+// Returns -1 if no digits follow.
+int readCommandNumber()
 {
-	// Setup logging
-	String welcomeMessage = "Connected to " + String(CLIENT_ID) + "\r\nOpen=O, Close=C, Stop=S, Check Error=E, Clear Error=X, WiFiSignal=W, Restart=R, Cur Temp=T\r\n";
-	LOG.setWelcomeMsg((char *)welcomeMessage.c_str());
-	LOG.begin(115200);
-
-	LedControl::begin();
+	int number = -1;
 
-#ifdef ENABLE_TEMP_FEATURE
-	TemparatureControl::begin();
-#endif
+	while (LOG.available() > 0 && isDigit(LOG.peek()))
+	{
+		number = (number < 0 ? 0 : number * 10) + (LOG.read() - '0');
+	}
 
-	WiFiControl::begin();
-	MotorControl::begin();
-	Utilities::begin();
-	OtaHandler::begin();
-	RemoteControl::begin();
-	MqttControl::begin();
+	return number;
 }
 
-void loop()
+void handleTelnetCommands()
 {
-	LedControl::handle();
-
-#ifdef ENABLE_TEMP_FEATURE
-	TemparatureControl::handle();
-#endif
-
-	WiFiControl::handle();
-	MotorControl::handle();
-	Utilities::handle();
-	OtaHandler::handle();
-	RemoteControl::handle();
-	MqttControl::handle();
-
-
-	// Don't handle Telnet logging while motor is running,
-    // this will cause the motor to stall under load.
-	if (!MotorControl::isMotorMoving())
-	{
-		LOG.handle();
-	}
-
 	// Handle Telnet commands for testing
 	if (LOG.available() > 0)
 	{
 		char command = LOG.read();
 
+#ifdef ENABLE_TEMP_FEATURE
+		// Window commands take over from the thermostat, like the remote and MQTT ones
+		if (command == 'O' || command == 'C' || command == 'S' || command == 'K')
+		{
+			Thermostat::override();
+		}
+#endif
+
 		if (command == 'O')
 		{
-			MotorControl::setRequestedMotorState(MotorState::OPENING);
+			int percent = readCommandNumber();
+
+			if (percent < 0)
+			{
+				MotorControl::setRequestedMotorState(MotorState::OPENING);
+			}
+			else
+			{
+				MotorControl::setRequestedPosition(percent);
+			}
 		}
 		else if (command == 'C')
 		{
@@ -77,6 +70,40 @@ void loop()
 		{
 			MotorControl::setRequestedMotorState(MotorState::STOPPED);
 		}
+		else if (command == 'P')
+		{
+			if (MotorControl::isPositionKnown())
+			{
+				LOG.printf("Window is %d%% open.\n", MotorControl::getPositionPercent());
+			}
+			else
+			{
+				LOG.println("Window position is unknown.");
+			}
+
+			TravelModel::printStats();
+			LOG.printf("Endstop glitches rejected: open %u, closed %u\n", (unsigned int)Endstops::getGlitchCount(Endstop::OPEN), (unsigned int)Endstops::getGlitchCount(Endstop::CLOSED));
+			LOG.printf("Motor commands coalesced: %u\n", (unsigned int)MotionPlanner::getCoalescedCount());
+			LOG.printf("Log messages dropped: %u (%u bytes)\n", (unsigned int)LOG.getDroppedWrites(), (unsigned int)LOG.getDroppedBytes());
+			MqttOutbox::printStats();
+		}
+		else if (command == 'M')
+		{
+			MotorControl::printMoveLog();
+		}
+		else if (command == 'L')
+		{
+#if LOOP_PROFILER
+			LoopProfiler::printReport();
+			LoopProfiler::reset();
+#else
+			LOG.println("Loop profiler not enabled in this build.");
+#endif
+		}
+		else if (command == 'K')
+		{
+			MotorControl::requestCalibration();
+		}
 		else if (command == 'E')
 		{
 			if (LedControl::hasErrorOccured())
@@ -107,11 +134,85 @@ void loop()
 		else if (command == 'T')
 		{
 #ifdef ENABLE_TEMP_FEATURE
-			LOG.print("Temperature F: ");
-			LOG.println(TemparatureControl::getCurrentTempF());
+			for (uint8_t i = 0; i < TemparatureControl::getSensorCount(); i++)
+			{
+				char temperature[12];
+				TemperatureFormat::formatF(TemparatureControl::getCurrentTemp(i), 2, temperature, sizeof(temperature));
+				LOG.printf("Temperature %u F: %s\n", (unsigned int)i, temperature);
+			}
+			LOG.printf("Read %lu ms ago\n", TemparatureControl::getReadingAge());
+			Thermostat::printStatus();
 #else
 			LOG.println("Temp feature not supported on this controller.");
 #endif
 		}
 	}
-}
\ No newline at end of file
+}
+
+void setup()
+{
+	// Setup logging
+	String welcomeMessage = "Connected to " + String(CLIENT_ID) + "\r\nOpen=O, Open To Percent=O<0-100>, Close=C, Stop=S, Position=P, Move Log=M, Loop Profile=L, Calibrate=K, Check Error=E, Clear Error=X, WiFiSignal=W, Restart=R, Cur Temp=T\r\n";
+	LOG.setWelcomeMsg((char *)welcomeMessage.c_str());
+	LOG.begin(115200);
+
+	LedControl::begin();
+
+#ifdef ENABLE_TEMP_FEATURE
+	TemparatureControl::begin();
+	TemperatureHistory::begin();
+	Thermostat::begin();
+#endif
+
+	WiFiControl::begin();
+	MotorControl::begin();
+	Utilities::begin();
+	OtaHandler::begin();
+	RemoteControl::begin();
+	MqttControl::begin();
+
+	// The motor path runs every pass, everything else when it is due.
+	// WiFiControl::handle() has nothing to do and is not scheduled.
+	Scheduler::setBusyCheck(MotorControl::isMotorMoving);
+	Scheduler::add(MotorControl::handle, 0, TaskPriority::MOTION, (uint8_t)LoopModule::MOTOR);
+	Scheduler::add(EventBus::dispatch, EVENT_BUS_HANDLE_PERIOD, TaskPriority::CONTROL, (uint8_t)LoopModule::EVENTS);
+	Scheduler::add(RemoteControl::handle, REMOTE_HANDLE_PERIOD, TaskPriority::CONTROL, (uint8_t)LoopModule::REMOTE);
+	Scheduler::add(MqttControl::handle, MQTT_HANDLE_PERIOD, TaskPriority::CONTROL, (uint8_t)LoopModule::MQTT);
+	Scheduler::add(handleTelnetCommands, TELNET_HANDLE_PERIOD, TaskPriority::CONTROL, (uint8_t)LoopModule::TELNET);
+	Scheduler::add(LedControl::handle, LED_HANDLE_PERIOD, TaskPriority::BACKGROUND, (uint8_t)LoopModule::LED);
+	Scheduler::add(Utilities::handle, UTILITIES_HANDLE_PERIOD, TaskPriority::BACKGROUND, (uint8_t)LoopModule::UTILITIES);
+	Scheduler::add(OtaHandler::handle, OTA_HANDLE_PERIOD, TaskPriority::BACKGROUND, (uint8_t)LoopModule::OTA);
+
+#ifdef ENABLE_TEMP_FEATURE
+	Scheduler::add(TemparatureControl::handle, TEMPERATURE_HANDLE_PERIOD, TaskPriority::BACKGROUND, (uint8_t)LoopModule::TEMPERATURE);
+#endif
+}
+
+void loop()
+{
+	LOOP_PROFILE_BEGIN();
+	Scheduler::run();
+	LOOP_PROFILE_END();
+
+#if STEP_BACKEND == STEP_BACKEND_POLLED
+	// The polled motion task runs at this priority, let it step between loop passes
+	yield();
+#endif
+}
+
+#ifdef NATIVE_BUILD
+#include "sim_window.h"
+
+// Host build entry point, runs the firmware against the simulated window
+int main()
+{
+	SimWindow::begin();
+	setup();
+
+	for (;;)
+	{
+		loop();
+		yield();
+	}
+}
+#endif
@@ -0,0 +1,104 @@
+#pragma once
+// Shared by the host benchmarks in tools/: self-checks that stop the run
+// before anything is timed, a timing loop and a heap allocation count.
+// Include from one source file only, it replaces operator new.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+
+class Bench
+{
+private:
+    static unsigned int failures;
+
+public:
+    static unsigned long allocations; // operator new calls since start
+
+    static void fail(const char *format, ...);
+    static bool passed(); // False, after a summary, if any check failed
+
+    // Runs body(i) for i in [0, count), returns ns per run
+    template <typename Body>
+    static double nanosPerRun(unsigned long count, Body body, unsigned long *allocationsPerRun = NULL);
+};
+
+// Static member definitions
+unsigned int Bench::failures = 0;
+unsigned long Bench::allocations = 0;
+
+// Public methods
+void Bench::fail(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    printf("FAIL ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    failures++;
+}
+
+bool Bench::passed()
+{
+    if (failures > 0)
+    {
+        printf("%u checks failed, nothing timed\n", failures);
+    }
+    return failures == 0;
+}
+
+template <typename Body>
+double Bench::nanosPerRun(unsigned long count, Body body, unsigned long *allocationsPerRun)
+{
+    unsigned long before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < count; i++)
+    {
+        body(i);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (allocationsPerRun != NULL)
+    {
+        *allocationsPerRun = (allocations - before) / count;
+    }
+    return elapsed.count() / count;
+}
+
+void *operator new(size_t size)
+{
+    Bench::allocations++;
+    void *memory = malloc(size);
+    if (memory == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
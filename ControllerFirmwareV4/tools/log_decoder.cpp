@@ -0,0 +1,280 @@
+// Turns a log captured from a BINARY_LOG build back into text.
+//
+//   g++ -std=c++14 -O2 -o log_decoder tools/log_decoder.cpp
+//   ./log_decoder include/*.h src/*.cpp < capture.bin
+//
+// The message table is rebuilt from the LOG_EVENT() sites in the given
+// sources, so decode with the sources of the firmware that wrote the log.
+// Anything outside a record is plain text and is passed through unchanged.
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Must match binary_log.h and shared.h
+static const uint8_t RECORD_MARKER = 0xFE;
+static const char *LOG_SITE = "LOG_EVENT(";
+
+static uint32_t messageId(const std::string &format)
+{
+    uint32_t hash = 2166136261UL;
+    for (unsigned char c : format)
+    {
+        hash = (hash ^ c) * 16777619UL;
+    }
+    return hash;
+}
+
+// Reads the string literal(s) starting at pos, adjacent literals are joined
+static bool readLiteral(const std::string &source, size_t pos, std::string &literal)
+{
+    bool found = false;
+
+    for (;;)
+    {
+        while (pos < source.size() && isspace((unsigned char)source[pos]))
+        {
+            pos++;
+        }
+
+        if (pos >= source.size() || source[pos] != '"')
+        {
+            return found;
+        }
+
+        for (pos++; pos < source.size() && source[pos] != '"'; pos++)
+        {
+            char c = source[pos];
+            if (c == '\\' && pos + 1 < source.size())
+            {
+                switch (source[++pos])
+                {
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case '0': c = '\0'; break;
+                default: c = source[pos]; break;
+                }
+            }
+            literal += c;
+        }
+
+        pos++;
+        found = true;
+    }
+}
+
+static void loadFormats(const char *path, std::map<uint32_t, std::string> &formats)
+{
+    std::ifstream file(path);
+    std::stringstream content;
+    content << file.rdbuf();
+    std::string source = content.str();
+
+    for (size_t pos = source.find(LOG_SITE); pos != std::string::npos; pos = source.find(LOG_SITE, pos + 1))
+    {
+        std::string format;
+        if (!readLiteral(source, pos + strlen(LOG_SITE), format))
+        {
+            // The macro definition itself
+            continue;
+        }
+
+        uint32_t id = messageId(format);
+        auto existing = formats.find(id);
+        if (existing != formats.end() && existing->second != format)
+        {
+            fprintf(stderr, "Message ID %08x is used by two different formats, \"%s\" is ignored.\n", id, format.c_str());
+            continue;
+        }
+        formats[id] = format;
+    }
+}
+
+class PayloadReader
+{
+private:
+    const std::vector<uint8_t> &payload;
+    size_t pos = 0;
+
+public:
+    PayloadReader(const std::vector<uint8_t> &bytes) : payload(bytes) {}
+
+    bool readWord(uint32_t &value)
+    {
+        if (pos + 4 > payload.size())
+        {
+            return false;
+        }
+        value = payload[pos] | (payload[pos + 1] << 8) | (payload[pos + 2] << 16) | ((uint32_t)payload[pos + 3] << 24);
+        pos += 4;
+        return true;
+    }
+
+    bool readString(std::string &value)
+    {
+        if (pos >= payload.size() || pos + 1 + payload[pos] > payload.size())
+        {
+            return false;
+        }
+        value.assign((const char *)&payload[pos + 1], payload[pos]);
+        pos += 1 + payload[pos];
+        return true;
+    }
+};
+
+static std::string formatRecord(const std::string &format, const std::vector<uint8_t> &payload)
+{
+    PayloadReader reader(payload);
+    std::string out;
+    char buffer[512];
+
+    for (size_t pos = 0; pos < format.size(); pos++)
+    {
+        if (format[pos] != '%')
+        {
+            out += format[pos];
+            continue;
+        }
+
+        // One conversion, e.g. %-6.2f or %lu
+        size_t end = pos + 1;
+        while (end < format.size() && strchr("-+ #0123456789.*hlLzjt", format[end]) != NULL)
+        {
+            end++;
+        }
+        if (end >= format.size())
+        {
+            break;
+        }
+
+        char conversion = format[end];
+        std::string spec = format.substr(pos, end - pos);
+        // Arguments are always 32 bits on the device, drop the length modifiers
+        spec.erase(spec.find_last_not_of("hlLzjt") + 1);
+        spec += conversion;
+        pos = end;
+
+        uint32_t word;
+        std::string text;
+        switch (conversion)
+        {
+        case '%':
+            out += '%';
+            continue;
+
+        case 'd':
+        case 'i':
+            if (!reader.readWord(word))
+            {
+                out += '?';
+                continue;
+            }
+            snprintf(buffer, sizeof(buffer), spec.c_str(), (int32_t)word);
+            break;
+
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+            if (!reader.readWord(word))
+            {
+                out += '?';
+                continue;
+            }
+            snprintf(buffer, sizeof(buffer), spec.c_str(), word);
+            break;
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        {
+            if (!reader.readWord(word))
+            {
+                out += '?';
+                continue;
+            }
+            float value;
+            memcpy(&value, &word, sizeof(value));
+            snprintf(buffer, sizeof(buffer), spec.c_str(), (double)value);
+            break;
+        }
+
+        case 's':
+            if (!reader.readString(text))
+            {
+                out += '?';
+                continue;
+            }
+            snprintf(buffer, sizeof(buffer), spec.c_str(), text.c_str());
+            break;
+
+        default:
+            snprintf(buffer, sizeof(buffer), "%s", spec.c_str());
+            break;
+        }
+
+        out += buffer;
+    }
+
+    return out;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <firmware sources...> < capture\n", argv[0]);
+        return 1;
+    }
+
+    std::map<uint32_t, std::string> formats;
+    for (int i = 1; i < argc; i++)
+    {
+        loadFormats(argv[i], formats);
+    }
+
+    int c;
+    while ((c = getchar()) != EOF)
+    {
+        if (c != RECORD_MARKER)
+        {
+            putchar(c);
+            continue;
+        }
+
+        uint8_t header[5];
+        if (fread(header, 1, sizeof(header), stdin) != sizeof(header))
+        {
+            break;
+        }
+
+        uint32_t id = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+        std::vector<uint8_t> payload(header[4]);
+        if (!payload.empty() && fread(payload.data(), 1, payload.size(), stdin) != payload.size())
+        {
+            break;
+        }
+
+        auto format = formats.find(id);
+        if (format == formats.end())
+        {
+            printf("<unknown message %08x, %u byte payload>\n", id, (unsigned int)payload.size());
+        }
+        else
+        {
+            fputs(formatRecord(format->second, payload).c_str(), stdout);
+        }
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+// Host benchmark for the MQTT command dispatch in include/mqtt_dispatch.h.
+//
+//   g++ -std=c++14 -O2 -o mqtt_dispatch_bench tools/mqtt_dispatch_bench.cpp
+//   ./mqtt_dispatch_bench [messages]
+//
+// Checks that every sample message parses as expected, then reports messages
+// per second for MqttDispatch and for the String based dispatch it replaced,
+// modelled with std::string: the topic and the payload are copied one char
+// at a time and compared as whole strings.
+#include <string.h>
+#include <string>
+
+#include "bench_harness.h"
+
+// Must match shared.h
+#define MQTT_DISPATCH_MAX_TOPICS 8
+#define MQTT_DISPATCH_MAX_PAYLOAD 32
+#include "../include/mqtt_dispatch.h"
+
+struct Sample
+{
+    const char *topicName;
+    const char *payload;
+    MqttTopic topic;
+    MqttVerb verb;
+    int argument;
+};
+
+static const char *COMMAND_TOPIC = "East_Window/COMMAND";
+static const char *TEMP_REQUEST_TOPIC = "TEMP_REQUEST";
+
+static const Sample samples[] = {
+    {COMMAND_TOPIC, "OPEN", MqttTopic::COMMAND, MqttVerb::OPEN, 0},
+    {COMMAND_TOPIC, "CLOSE", MqttTopic::COMMAND, MqttVerb::CLOSE, 0},
+    {COMMAND_TOPIC, "STOP", MqttTopic::COMMAND, MqttVerb::STOP, 0},
+    {COMMAND_TOPIC, "OPEN 35", MqttTopic::COMMAND, MqttVerb::OPEN_PERCENT, 35},
+    {COMMAND_TOPIC, "OPEN x", MqttTopic::COMMAND, MqttVerb::UNKNOWN, 0},
+    {COMMAND_TOPIC, "CALIBRATE", MqttTopic::COMMAND, MqttVerb::CALIBRATE, 0},
+    {COMMAND_TOPIC, "RESTART", MqttTopic::COMMAND, MqttVerb::RESTART, 0},
+    {TEMP_REQUEST_TOPIC, "TEMP", MqttTopic::TEMP_REQUEST, MqttVerb::TEMP, 0},
+    {TEMP_REQUEST_TOPIC, "HISTORY", MqttTopic::TEMP_REQUEST, MqttVerb::HISTORY, 0},
+    {"West_Window/COMMAND", "OPEN", MqttTopic::UNKNOWN, MqttVerb::UNKNOWN, 0},
+};
+static const size_t SAMPLE_COUNT = sizeof(samples) / sizeof(samples[0]);
+
+// The old onMessageRecived(), without the motor calls
+static int stringDispatch(const char *topic, const uint8_t *message, unsigned int length)
+{
+    std::string response;
+    std::string _topic = std::string(topic);
+
+    for (unsigned int i = 0; i < length; i++)
+    {
+        response += (char)message[i];
+    }
+
+    if (_topic == COMMAND_TOPIC)
+    {
+        if (response == "OPEN")
+            return 1;
+        else if (response == "CLOSE")
+            return 3;
+        else if (response == "STOP")
+            return 4;
+        else if (response.compare(0, 5, "OPEN ") == 0)
+            return atoi(response.substr(5).c_str());
+        else if (response == "CALIBRATE")
+            return 5;
+        else if (response == "RESTART")
+            return 6;
+    }
+    else if (_topic == TEMP_REQUEST_TOPIC)
+    {
+        if (response == "TEMP")
+            return 7;
+        else if (response == "HISTORY")
+            return 8;
+    }
+    return 0;
+}
+
+template <typename Dispatch>
+static double messagesPerSecond(unsigned long count, Dispatch dispatch)
+{
+    return 1e9 / Bench::nanosPerRun(count, [&dispatch](unsigned long i) {
+        dispatch(samples[i % SAMPLE_COUNT]);
+    });
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long count = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000UL;
+
+    MqttDispatch::addTopic(COMMAND_TOPIC, MqttTopic::COMMAND);
+    MqttDispatch::addTopic(TEMP_REQUEST_TOPIC, MqttTopic::TEMP_REQUEST);
+
+    for (size_t i = 0; i < SAMPLE_COUNT; i++)
+    {
+        const Sample &sample = samples[i];
+        MqttMessage message;
+        MqttDispatch::parse(sample.topicName, (const uint8_t *)sample.payload, strlen(sample.payload), message);
+
+        if (message.topic != sample.topic || message.verb != sample.verb || message.argument != sample.argument || strcmp(message.payload, sample.payload) != 0)
+        {
+            Bench::fail("[%s] %s", sample.topicName, sample.payload);
+        }
+    }
+    if (!Bench::passed())
+    {
+        return 1;
+    }
+
+    volatile unsigned int sink = 0;
+    double parsed = messagesPerSecond(count, [&sink](const Sample &sample) {
+        MqttMessage message;
+        MqttDispatch::parse(sample.topicName, (const uint8_t *)sample.payload, strlen(sample.payload), message);
+        sink += (unsigned int)message.verb + message.argument;
+    });
+    double strings = messagesPerSecond(count, [&sink](const Sample &sample) {
+        sink += stringDispatch(sample.topicName, (const uint8_t *)sample.payload, strlen(sample.payload));
+    });
+
+    printf("%lu messages over %u samples\n", count, (unsigned int)SAMPLE_COUNT);
+    printf("MqttDispatch:    %12.0f messages/s\n", parsed);
+    printf("String dispatch: %12.0f messages/s\n", strings);
+    return 0;
+}
@@ -0,0 +1,127 @@
+// Host benchmark for the temperature publish path, built against the
+// firmware headers and the shims in native/:
+//
+//   g++ -std=gnu++14 -O2 -pthread -Inative -Iinclude -DNATIVE_BUILD '-DCLIENT_ID="Bench"' -DFIRMWARE_VERSION=0 -DENABLE_TEMP_FEATURE -DSTEP_BACKEND=STEP_BACKEND_POLLED -o temperature_publish_bench tools/temperature_publish_bench.cpp
+//   ./temperature_publish_bench [publishes]
+//
+// Checks formatF() against the exact value and parseF() round trips over the
+// whole DS18B20 range, then reports heap allocations and time per publish.
+// A publish is a reading going through the event bus, MqttControl's
+// deadband and queueTemperature(), MqttOutbox::put() and flush() and
+// PubSubClient::publish(). The float and String path it replaced goes
+// through the same outbox and client, with String(float) modelled with its
+// text on the heap like Arduino's.
+#include <math.h>
+
+#include "bench_harness.h"
+
+#include <Arduino.h>
+#include "utility_functions.h" // Before mqtt_control.h, as in main.cpp
+#include "mqtt_control.h"
+
+// String(float) as the firmware used it
+class HeapString
+{
+private:
+    char *text;
+
+public:
+    explicit HeapString(float value)
+    {
+        char buffer[33];
+        int length = snprintf(buffer, sizeof(buffer), "%.2f", value);
+        text = new char[length + 1];
+        memcpy(text, buffer, length + 1);
+    }
+
+    ~HeapString()
+    {
+        delete[] text;
+    }
+
+    const char *c_str() const
+    {
+        return text;
+    }
+};
+
+static const TemperatureRaw RAW_MIN = -55 * TEMPERATURE_RAW_PER_C;
+static const TemperatureRaw RAW_MAX = 125 * TEMPERATURE_RAW_PER_C;
+static const int RAW_RANGE = RAW_MAX - RAW_MIN + 1;
+
+// Steps past the deadband so every reading is published, and visits every
+// raw value since it shares no factor with the range
+static const int RAW_STRIDE = MQTT_TEMP_DEADBAND * 2 + 1;
+
+static TemperatureRaw reading(unsigned long i)
+{
+    return (TemperatureRaw)(RAW_MIN + (long)((i * RAW_STRIDE) % RAW_RANGE));
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long count = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000UL;
+
+    for (int raw = RAW_MIN; raw <= RAW_MAX; raw++)
+    {
+        char text[12];
+        TemperatureFormat::formatF((TemperatureRaw)raw, 2, text, sizeof(text));
+
+        // Within half a hundredth of the exact value
+        double exact = raw * 9.0 / 80.0 + 32.0;
+        if (fabs(atof(text) - exact) > 0.005 + 1e-9)
+        {
+            Bench::fail("format %d: %s, exact %.4f", raw, text, exact);
+        }
+
+        const char *cursor = text;
+        TemperatureRaw parsed = 0;
+        if (!TemperatureFormat::parseF(cursor, parsed) || parsed != raw || *cursor != '\0')
+        {
+            Bench::fail("parse %d: %s gave %d", raw, text, (int)parsed);
+        }
+    }
+
+    MqttControl::begin();
+    mqttClient.connect(CLIENT_ID, CLIENT_ID, MQTT_SERVER_PASSWORD);
+    mqttClient.echo = false;
+
+    // Every reading has to make it to the client
+    uint32_t published = mqttClient.publishCount;
+    for (unsigned long i = 0; i < (unsigned long)RAW_RANGE; i++)
+    {
+        EventBus::publish(Event::temperatureRead(0, reading(i)));
+        EventBus::dispatch();
+        MqttOutbox::flush();
+    }
+    if (mqttClient.publishCount - published != (uint32_t)RAW_RANGE || MqttOutbox::getPendingCount() != 0)
+    {
+        Bench::fail("%u of %d readings published", (unsigned int)(mqttClient.publishCount - published), RAW_RANGE);
+    }
+
+    if (!Bench::passed())
+    {
+        return 1;
+    }
+
+    unsigned long fixedAllocations = 0;
+    unsigned long stringAllocations = 0;
+
+    double fixed = Bench::nanosPerRun(count, [](unsigned long i) {
+        EventBus::publish(Event::temperatureRead(0, reading(i)));
+        EventBus::dispatch();
+        MqttOutbox::flush();
+    }, &fixedAllocations);
+
+    double strings = Bench::nanosPerRun(count, [](unsigned long i) {
+        float temperatureF = reading(i) / 16.0f * 1.8f + 32.0f;
+        HeapString payload(temperatureF);
+        MqttOutbox::put(TEMP_SENSOR_TOPICS[0], payload.c_str());
+        MqttOutbox::flush();
+    }, &stringAllocations);
+
+    printf("%lu publishes over %d raw values\n", count, RAW_RANGE);
+    printf("Fixed point:    %8.1f ns, %lu allocations per publish\n", fixed, fixedAllocations);
+    printf("Float + String: %8.1f ns, %lu allocations per publish\n", strings, stringAllocations);
+    return 0;
+}